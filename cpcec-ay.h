@@ -86,12 +86,17 @@ INLINE void psg_table_sendto(BYTE x,BYTE i)
 #define psg_setup()
 
 // The PlayCity extension requires its own logic as it isn't just an extra pair of AY chips!
+// Its engine is generic, though: PSG_PLAYCITY_CHIPS extra chips (two on the CPC PlayCity,
+// one on the Spectrum TurboSound) with their own mix matrix: chip x channel x left+right.
 
 #ifdef PSG_PLAYCITY
-int playcity_clock=0; BYTE playcity_table[2][16],playcity_index[2],playcity_hard_new[2];
-int playcity_hard_style[2],playcity_hard_count[2],playcity_hard_level[2],playcity_hard_flag0[2],playcity_hard_flag2[2];
+#ifndef PSG_PLAYCITY_CHIPS
+#define PSG_PLAYCITY_CHIPS 2
+#endif
+int playcity_clock=0; BYTE playcity_table[PSG_PLAYCITY_CHIPS][16],playcity_index[PSG_PLAYCITY_CHIPS];
+int playcity_hard_style[PSG_PLAYCITY_CHIPS],playcity_hard_count[PSG_PLAYCITY_CHIPS],playcity_hard_level[PSG_PLAYCITY_CHIPS],playcity_hard_flag0[PSG_PLAYCITY_CHIPS],playcity_hard_flag2[PSG_PLAYCITY_CHIPS];
 #if AUDIO_CHANNELS > 1
-int playcity_stereo[2][2];
+int playcity_stereo[PSG_PLAYCITY_CHIPS][3][2];
 #endif
 void playcity_set_config(BYTE b)
 {
@@ -101,13 +106,13 @@ void playcity_set_config(BYTE b)
 #define playcity_get_config() (playcity_clock)
 void playcity_select(BYTE x,BYTE b)
 {
-	if (x<2)
+	if (x<PSG_PLAYCITY_CHIPS)
 		if (b<16)
 			playcity_index[x]=b;
 }
 void playcity_send(BYTE x,BYTE b)
 {
-	if (x<2)
+	if (x<PSG_PLAYCITY_CHIPS)
 	{
 		int y=playcity_index[x];
 		playcity_table[x][y]=(b&=psg_valid[y]);
@@ -118,10 +123,12 @@ void playcity_send(BYTE x,BYTE b)
 		}
 	}
 }
+#define playcity_recv(x) (playcity_table[x][playcity_index[x]])
 void playcity_reset(void)
 {
 	playcity_clock=0; MEMZERO(playcity_table);
-	playcity_table[0][7]=playcity_table[1][7]=0x3F; // 2 MHz, channels+noise off
+	for (int x=0;x<PSG_PLAYCITY_CHIPS;++x)
+		playcity_table[x][7]=0x3F; // 2 MHz, channels+noise off
 }
 #endif
 
@@ -138,33 +145,23 @@ void psg_reset(void) // reset the PSG AY-3-8910
 
 // YM3 file logging ------------------------------------------------- //
 
-char psg_tmpname[STRMAX];
-FILE *psg_logfile=NULL,*psg_tmpfile;
-int psg_nextlog=1,psg_tmpsize;
-unsigned char psg_tmp[14<<9],psg_log[1<<9]; // `psg_tmp` must be 14 times as big as `psg_log`!
+// registers are stored in memory as columns within chunks of PSG_LOG_CHUNK frames,
+// so closing the log only has to write each column of each chunk in a row.
+#define PSG_LOG_CHUNK (1<<12) // 4096 frames = 56k per chunk
+FILE *psg_logfile=NULL;
+BYTE **psg_logchunk=NULL; // list of chunks, each one 14 columns of PSG_LOG_CHUNK bytes
+int psg_nextlog=1,psg_logchunks,psg_logframe; // chunks in use and frames in the last chunk
 int psg_closelog(void)
 {
 	if (!psg_logfile)
 		return 1; // nothing to do!
 	fwrite("YM3!",1,4,psg_logfile);
-	fwrite1(psg_tmp,psg_tmpsize,psg_tmpfile);
-	fclose(psg_tmpfile);
-	if (psg_tmpfile=fopen(psg_tmpname,"rb"))
-	{
-		int c,l,i,o;
-		for (c=0;c<14;++c) // arrange byte dumps into long byte channels
-		{
-			fseek(psg_tmpfile,0,SEEK_SET);
-			while (l=fread1(psg_tmp,sizeof(psg_tmp),psg_tmpfile))
-			{
-				for (i=c,o=0;i<l;i+=14)
-					psg_log[o++]=psg_tmp[i];
-				fwrite1(psg_log,o,psg_logfile);
-			}
-		}
-		fclose(psg_tmpfile);
-	}
-	remove(psg_tmpname); // destroy temporary file
+	for (int c=0;c<14;++c) // arrange chunks into long byte channels
+		for (int i=0;i<psg_logchunks;++i)
+			fwrite1(&psg_logchunk[i][c*PSG_LOG_CHUNK],i+1<psg_logchunks?PSG_LOG_CHUNK:psg_logframe,psg_logfile);
+	while (psg_logchunks)
+		free(psg_logchunk[--psg_logchunks]);
+	free(psg_logchunk); psg_logchunk=NULL;
 	fclose(psg_logfile);
 	psg_logfile=NULL;
 	return 0;
@@ -173,34 +170,80 @@ int psg_createlog(char *s)
 {
 	if (psg_logfile)
 		return 1; // already busy!
-	if (!(psg_tmpfile=fopen(strcat(strcpy(psg_tmpname,s),"$"),"wb")))
-		return 1; // cannot create temporary file!
 	if (!(psg_logfile=fopen(s,"wb")))
-		return fclose(psg_tmpfile),1; // cannot create file!
-	return psg_tmpsize=0;
+		return 1; // cannot create file!
+	return psg_logchunks=0,psg_logframe=PSG_LOG_CHUNK; // force a new chunk on the first frame
 }
 void psg_writelog(void)
 {
 	if (psg_logfile)
 	{
+		if (psg_logframe>=PSG_LOG_CHUNK) // last chunk is full?
+		{
+			BYTE **l=realloc(psg_logchunk,sizeof(BYTE*)*(psg_logchunks+1));
+			if (l) psg_logchunk=l;
+			if (!l||!(psg_logchunk[psg_logchunks]=malloc(14*PSG_LOG_CHUNK)))
+				{ psg_closelog(); return; } // out of memory: save what we've got!
+			++psg_logchunks,psg_logframe=0;
+		}
+		BYTE *t=&psg_logchunk[psg_logchunks-1][psg_logframe++];
 		int i; // we must adjust YM values to a 2 MHz clock.
 		i=((psg_table[0]+psg_table[1]*256)*2000+PSG_KHZ_CLOCK/2)/PSG_KHZ_CLOCK; // channel 1 wavelength
-		psg_tmp[psg_tmpsize++]=i; psg_tmp[psg_tmpsize++]=i>>8;
+		t[0*PSG_LOG_CHUNK]=i; t[1*PSG_LOG_CHUNK]=i>>8;
 		i=((psg_table[2]+psg_table[3]*256)*2000+PSG_KHZ_CLOCK/2)/PSG_KHZ_CLOCK; // channel 2 wavelength
-		psg_tmp[psg_tmpsize++]=i; psg_tmp[psg_tmpsize++]=i>>8;
+		t[2*PSG_LOG_CHUNK]=i; t[3*PSG_LOG_CHUNK]=i>>8;
 		i=((psg_table[4]+psg_table[5]*256)*2000+PSG_KHZ_CLOCK/2)/PSG_KHZ_CLOCK; // channel 3 wavelength
-		psg_tmp[psg_tmpsize++]=i; psg_tmp[psg_tmpsize++]=i>>8;
-		psg_tmp[psg_tmpsize++]=psg_table[6]; // noise wavelength
-		psg_tmp[psg_tmpsize++]=psg_table[7]; // mixer
-		psg_tmp[psg_tmpsize++]=psg_table[8]; // channel 1 amplitude
-		psg_tmp[psg_tmpsize++]=psg_table[9]; // channel 2 amplitude
-		psg_tmp[psg_tmpsize++]=psg_table[10]; // channel 3 amplitude
+		t[4*PSG_LOG_CHUNK]=i; t[5*PSG_LOG_CHUNK]=i>>8;
+		t[6*PSG_LOG_CHUNK]=psg_table[6]; // noise wavelength
+		t[7*PSG_LOG_CHUNK]=psg_table[7]; // mixer
+		t[8*PSG_LOG_CHUNK]=psg_table[8]; // channel 1 amplitude
+		t[9*PSG_LOG_CHUNK]=psg_table[9]; // channel 2 amplitude
+		t[10*PSG_LOG_CHUNK]=psg_table[10]; // channel 3 amplitude
 		i=((psg_table[11]+psg_table[12]*256)*2000+PSG_KHZ_CLOCK/2)/PSG_KHZ_CLOCK; // hard envelope wavelength
-		psg_tmp[psg_tmpsize++]=i; psg_tmp[psg_tmpsize++]=i>>8;
-		psg_tmp[psg_tmpsize++]=psg_hard_log; // hard envelope type
+		t[11*PSG_LOG_CHUNK]=i; t[12*PSG_LOG_CHUNK]=i>>8;
+		t[13*PSG_LOG_CHUNK]=psg_hard_log; // hard envelope type
 		psg_hard_log=0xFF; // 0xFF means the hard envelope doesn't change
-		if (psg_tmpsize>=sizeof(psg_tmp))
-			fwrite1(psg_tmp,sizeof(psg_tmp),psg_tmpfile),psg_tmpsize=0;
+	}
+}
+
+// per-channel WAV stems -------------------------------------------- //
+
+// channels A, B and C and the base signal (tape, beeper...) are stored apart
+// while `psg_main` mixes them, then saved as a 4-channel 16-bit WAV file.
+FILE *psg_stemfile=NULL; int psg_nextstem=1,psg_stemsize;
+short psg_stem[AUDIO_LENGTH_Z][4]; // A, B, C, base
+int psg_closestem(void)
+{
+	if (!psg_stemfile)
+		return 1; // nothing to do!
+	fseek(psg_stemfile,0x28,SEEK_SET);
+	fputiiii(psg_stemsize,psg_stemfile);
+	fseek(psg_stemfile,0x04,SEEK_SET);
+	fputiiii(psg_stemsize+36,psg_stemfile); // file=head+data
+	fclose(psg_stemfile);
+	psg_stemfile=NULL;
+	return 0;
+}
+int psg_createstem(char *s)
+{
+	if (psg_stemfile)
+		return 1; // already busy!
+	if (!(psg_stemfile=fopen(s,"wb")))
+		return 1; // cannot create file!
+	fwrite("RIFF\000\000\000\000WAVEfmt \020\000\000\000\001\000\004\000",1,24,psg_stemfile); // PCM, 4 channels
+	fputiiii(AUDIO_PLAYBACK,psg_stemfile); // samples per second
+	fputiiii(AUDIO_PLAYBACK*8,psg_stemfile); // bytes per second
+	fputii(8,psg_stemfile); fputii(16,psg_stemfile); // bytes per sample, bits per channel
+	fwrite("data\000\000\000\000",1,8,psg_stemfile);
+	MEMZERO(psg_stem);
+	return psg_stemsize=0;
+}
+void psg_writestem(void)
+{
+	if (psg_stemfile)
+	{
+		psg_stemsize+=fwrite1(psg_stem,sizeof(psg_stem),psg_stemfile);
+		MEMZERO(psg_stem); // keep silent frames silent
 	}
 }
 
@@ -245,7 +288,7 @@ void psg_main(int t,int d) // render audio output for `t` clock ticks, with `d`
 		static int o=0,p=0; // output averaging variables
 		#endif
 		#if PSG_MAIN_EXTRABITS
-		static int n=0; // oversampling loops
+		static int n=0,q=0; // oversampling loops and base signal
 		#endif
 		p+=AUDIO_PLAYBACK<<PSG_MAIN_EXTRABITS;
 		while (p>0)
@@ -257,6 +300,9 @@ void psg_main(int t,int d) // render audio output for `t` clock ticks, with `d`
 			#else
 			o-=d;
 			#endif
+			#if PSG_MAIN_EXTRABITS
+			q-=d;
+			#endif
 			p-=TICKS_PER_SECOND/PSG_TICK_STEP;
 			#if PSG_MAIN_EXTRABITS
 			if (++n>>PSG_MAIN_EXTRABITS) // enough data to write a sample? `n` will never be >1 on CPC at 44100 Hz, but can be on ZX!
@@ -272,14 +318,24 @@ void psg_main(int t,int d) // render audio output for `t` clock ticks, with `d`
 							#else
 							o+=audio_table[psg_tone_power[c]]<<PSG_MAIN_EXTRABITS;
 							#endif
+				if (psg_stemfile) // record the channels apart
+				{
+					for (int c=0;c<3;++c)
+						psg_stem[audio_pos_z][c]=((psg_tone_state[c]|(psg_tone_catch[c]&(7*1)))&&(psg_noise_state|(psg_tone_catch[c]&(7*8))))?audio_table[psg_tone_power[c]]:0;
+					#if PSG_MAIN_EXTRABITS
+					psg_stem[audio_pos_z][3]=q/n;
+					#else
+					psg_stem[audio_pos_z][3]=-d;
+					#endif
+				}
 				#if PSG_MAIN_EXTRABITS
 				#if AUDIO_CHANNELS > 1
 				*audio_target++=(o0+n/2)/(n<<(24-AUDIO_BITDEPTH))+AUDIO_ZERO; // rounded average (left)
 				*audio_target++=(o1+n/2)/(n<<(24-AUDIO_BITDEPTH))+AUDIO_ZERO; // rounded average (right)
-				o0=o1=n=0; // reset output averaging variables
+				o0=o1=n=q=0; // reset output averaging variables
 				#else
 				*audio_target++=(o+n/2)/(n<<(16-AUDIO_BITDEPTH))+AUDIO_ZERO; // rounded average
-				o=n=0; // reset output averaging variables
+				o=n=q=0; // reset output averaging variables
 				#endif
 				#else
 				#if AUDIO_CHANNELS > 1
@@ -306,12 +362,16 @@ void psg_main(int t,int d) // render audio output for `t` clock ticks, with `d`
 #ifdef PSG_PLAYCITY
 void playcity_main(AUDIO_UNIT *t,int l)
 {
-	int dirty_l=playcity_table[0][7]==0x3F,dirty_h=playcity_table[1][7]!=0x3F;
-	if (dirty_l>dirty_h||!l) return; // disabled chips? no buffer!
-	int playcity_tone_limit[2][3],playcity_tone_power[2][3],playcity_tone_mixer[2][3],playcity_noise_limit[2],playcity_hard_limit[2];
-	static int playcity_tone_count[2][3],playcity_tone_state[2][3]={{0,0,0},{0,0,0}},playcity_noise_state[2],playcity_noise_count[2],playcity_noise_trash[2]={1,1},playcity_hard_power[2];
-	for (int x=dirty_l;x<=dirty_h;++x)
+	int playcity_chip[PSG_PLAYCITY_CHIPS],n=0; // only the chips in use are rendered
+	for (int x=0;x<PSG_PLAYCITY_CHIPS;++x)
+		if (playcity_table[x][7]!=0x3F)
+			playcity_chip[n++]=x;
+	if (!n||!l) return; // disabled chips? no buffer!
+	int playcity_tone_limit[PSG_PLAYCITY_CHIPS][3],playcity_tone_power[PSG_PLAYCITY_CHIPS][3],playcity_tone_mixer[PSG_PLAYCITY_CHIPS][3],playcity_noise_limit[PSG_PLAYCITY_CHIPS],playcity_hard_limit[PSG_PLAYCITY_CHIPS];
+	static int playcity_tone_count[PSG_PLAYCITY_CHIPS][3],playcity_tone_state[PSG_PLAYCITY_CHIPS][3],playcity_noise_state[PSG_PLAYCITY_CHIPS],playcity_noise_count[PSG_PLAYCITY_CHIPS],playcity_noise_trash[PSG_PLAYCITY_CHIPS],playcity_hard_power[PSG_PLAYCITY_CHIPS];
+	for (int i=0;i<n;++i)
 	{
+		int x=playcity_chip[i];
 		for (int c=0;c<3;++c) // preload channel limits
 		{
 			playcity_tone_power[x][c]=playcity_table[x][c*1+8];
@@ -323,19 +383,22 @@ void playcity_main(AUDIO_UNIT *t,int l)
 			playcity_noise_limit[x]=2; // half the rate
 		if (!(playcity_hard_limit[x]=(playcity_table[x][11]+playcity_table[x][12]*256)*2)) // hard envelope limits
 			playcity_hard_limit[x]=2; // half, ditto
+		if (!playcity_noise_trash[x])
+			playcity_noise_trash[x]=1; // the LFSR must never be zero
 	}
 	#if AUDIO_CHANNELS > 1
-	static int n=0,o0=0,o1=0,p=0;
+	static int m=0,o0=0,o1=0,p=0;
 	#else
-	static int n=0,o=0,p=0;
+	static int m=0,o=0,p=0;
 	#endif
 	int playcity_clock_hi=(playcity_clock?playcity_clock*2-1:2)*PSG_PLAYCITY*125,playcity_clock_lo=(playcity_clock?playcity_clock:1)*AUDIO_PLAYBACK*2; // where 125/2 = 1000/16
 	for (;;)
 	{
 		p+=playcity_clock_hi; while (p>=0)
 		{
-			for (int x=dirty_l;x<=dirty_h;++x) // update all chips
+			for (int i=0;i<n;++i) // update all chips
 			{
+				int x=playcity_chip[i];
 				if (--playcity_noise_count[x]<=0) // update noises
 				{
 					playcity_noise_count[x]=playcity_noise_limit[x];
@@ -367,26 +430,26 @@ void playcity_main(AUDIO_UNIT *t,int l)
 								z=playcity_hard_power[x];
 							if ((z-=2)>0) // each channel in Playcity plays at half the normal intensity
 								#if AUDIO_CHANNELS > 1
-								o0+=audio_table[z]*playcity_stereo[x][0],
-								o1+=audio_table[z]*playcity_stereo[x][1];
+								o0+=audio_table[z]*playcity_stereo[x][c][0],
+								o1+=audio_table[z]*playcity_stereo[x][c][1];
 								#else
 								o+=audio_table[z];
 								#endif
 						}
 				}
 			}
-			++n; p-=playcity_clock_lo;
+			++m; p-=playcity_clock_lo;
 		}
 		// generate negative samples (-50% x2) to avoid overflows against the central AY chip (+100%)
-		if (n) // enough data to write a sample? unlike the basic PSG, `n` is >1 at 44100 Hz (5 or 6)
+		if (m) // enough data to write a sample? unlike the basic PSG, `m` is >1 at 44100 Hz (5 or 6)
 		{
 			#if AUDIO_CHANNELS > 1
-			*t++-=(o0+n/2)/(n<<(24-AUDIO_BITDEPTH));
-			*t++-=(o1+n/2)/(n<<(24-AUDIO_BITDEPTH));
-			n=o0=o1=0;
+			*t++-=(o0+m/2)/(m<<(24-AUDIO_BITDEPTH));
+			*t++-=(o1+m/2)/(m<<(24-AUDIO_BITDEPTH));
+			m=o0=o1=0;
 			#else
-			*t++-=(o+n/2)/(n<<(16-AUDIO_BITDEPTH));
-			n=o=0;
+			*t++-=(o+m/2)/(m<<(16-AUDIO_BITDEPTH));
+			m=o=0;
 			#endif
 			if (!--l)
 				break;
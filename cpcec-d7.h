@@ -26,6 +26,16 @@ BYTE disc_index_table[4][256]; // "MV - CPC" disc header - one for each drive
 BYTE disc_track_table[8][512]; // current track info - one for each drive AND side, because one SEEK TRACK enables access to BOTH sides of said track!
 int disc_track_offset[8]; // current tracks' file offsets - one for each drive (drives A..D: 0..3) and side (side A +0, side B +4)
 
+// the whole disc image is kept in memory, and the file offsets of all tracks are calculated
+// just once, so reading tracks and sectors doesn't need any file operations at all.
+// the original file is never modified while the disc is in use: writes and formats only
+// change the memory copy, and the changes are saved into a new file that replaces the old one
+// when the disc is removed or when the user asks for it; meanwhile, the file is read-only.
+
+BYTE *disc_image[4]={NULL,NULL,NULL,NULL}; int disc_imagesize[4]; // disc images in memory
+BYTE disc_imagedirty[4]; char disc_imagepath[4][STRMAX]; // unsaved changes and file paths
+int disc_track_index[4][110*2]; // file offsets of all tracks - one for each drive, track and side
+
 // each drive can hold a disc and point at a track, but the FDC is limited to one operation at once,
 // so parameters, buffers, pointers, counters, etc. are unique for the whole system.
 
@@ -55,28 +65,108 @@ void disc_track_reset(int drive) // invalidate drive `d` tracks on both sides
 	MEMZERO(disc_track_table[drive]); MEMZERO(disc_track_table[drive+4]);
 }
 
-void disc_close(int drive) // close disc file. drive = 0 (A:) or 1 (B:)
+int disc_image_flush(int drive) // save the changes of disc `drive` into a new file that replaces the old one; 0 OK, !0 ERROR
+{
+	if (!disc[drive]||!disc_imagedirty[drive])
+		return 0; // nothing to save
+	FILE *f; char t[STRMAX+8];
+	sprintf(t,"%s.$$$",disc_imagepath[drive]);
+	if (!(f=fopen(t,"wb")))
+		return 1; // cannot create file!
+	int q=fwrite1(disc_image[drive],disc_imagesize[drive],f)!=disc_imagesize[drive];
+	if (fclose(f)|q)
+		return remove(t),1; // cannot write file!
+	puff_fclose(disc[drive]); // the old file must be released before replacing it
+	if (rename(t,disc_imagepath[drive])) // some systems won't replace files when renaming: move the old file aside first
+	{
+		char u[STRMAX+8];
+		sprintf(u,"%s.bak",disc_imagepath[drive]);
+		if (!(q=rename(disc_imagepath[drive],u)))
+		{
+			if (q=rename(t,disc_imagepath[drive]))
+				rename(u,disc_imagepath[drive]); // restore the old file; the new one stays as a temporary file
+			else
+				remove(u);
+		}
+	}
+	if (!(disc[drive]=puff_fopen(disc_imagepath[drive],"rb")))
+		disc[drive]=puff_fopen(t,"rb"); // the handle is still required
+	return disc_imagedirty[drive]=q;
+}
+int disc_close(int drive) // close disc file. drive = 0 (A:) or 1 (B:); 0 OK, !0 ERROR (the changes were lost)
 {
+	int q=0;
 	if (disc[drive])
-		disc_track_reset(drive),puff_fclose(disc[drive]);
-	disc_change[drive]=1,disc[drive]=NULL;
+		q=disc_image_flush(drive),disc_track_reset(drive);
+	if (disc[drive])
+		puff_fclose(disc[drive]);
+	if (disc_image[drive])
+		free(disc_image[drive]),disc_image[drive]=NULL;
+	return disc_change[drive]=1,disc_imagedirty[drive]=0,disc[drive]=NULL,q;
+}
+
+void disc_image_index(int drive) // calculate the file offsets of the tracks of disc `drive`
+{
+	int i=256,j; // disc header must be skipped
+	for (j=0;j<disc_index_table[drive][0x30]*disc_index_table[drive][0x31];++j)
+	{
+		disc_track_index[drive][j]=i;
+		if (disc_index_table[drive][0]=='M') // old style
+			i+=disc_index_table[drive][0x32]+disc_index_table[drive][0x33]*256; // all tracks are the same size, in bytes
+		else if (j<256-0x34) // new style
+			i+=disc_index_table[drive][j+0x34]*256; // each track stores its own size, in 256-byte pages
+	}
+}
+int disc_image_load(int drive) // load the whole disc file in memory and index its tracks; 0 OK, !0 ERROR
+{
+	if (disc_image[drive])
+		free(disc_image[drive]),disc_image[drive]=NULL;
+	fseek(disc[drive],0,SEEK_END);
+	if ((disc_imagesize[drive]=ftell(disc[drive]))<256||!(disc_image[drive]=malloc(disc_imagesize[drive])))
+		return 1; // cannot load disc!
+	fseek(disc[drive],0,SEEK_SET);
+	disc_imagesize[drive]=fread1(disc_image[drive],disc_imagesize[drive],disc[drive]);
+	return disc_image_index(drive),disc_imagedirty[drive]=0;
+}
+int disc_image_read(int drive,int o,BYTE *t,int l) // copy `l` bytes at offset `o` of disc `drive` into `t`; returns the amount of bytes copied
+{
+	if (o<0||o>=disc_imagesize[drive])
+		return 0; // nothing to copy!
+	if (l>disc_imagesize[drive]-o)
+		l=disc_imagesize[drive]-o; // clip!
+	return memcpy(t,&disc_image[drive][o],l),l;
+}
+int disc_image_write(int drive,int o,BYTE *t,int l) // store `l` bytes from `t` at offset `o` of disc `drive`; returns the amount of bytes stored
+{
+	if (o+l>disc_imagesize[drive]) // must the image grow?
+	{
+		BYTE *z; if (!(z=realloc(disc_image[drive],o+l)))
+			return 0; // cannot grow!
+		memset(&(disc_image[drive]=z)[disc_imagesize[drive]],0,o+l-disc_imagesize[drive]); disc_imagesize[drive]=o+l;
+	}
+	return disc_imagedirty[drive]=1,memcpy(&disc_image[drive][o],t,l),l; // the file will be updated later
 }
 
 int disc_open(char *s,int drive,int canwrite) // open a disc file. `s` path, `drive` = 0 (A:) or 1 (B:); 0 OK, !0 ERROR
 {
 	disc_close(drive);
-	if (!(disc[drive]=puff_fopen(s,(disc_canwrite[drive]=canwrite)?"rb+":"rb")))
+	if (!(disc[drive]=puff_fopen(s,"rb"))) // the file is never written while it's open
 		return 1; // cannot open disc!
+	disc_canwrite[drive]=canwrite;
 	int q=1; // error flag
 	if (fread(disc_index_table[drive],1,256,disc[drive])==256
 		&&disc_index_table[drive][0x30]<110&&disc_index_table[drive][0x31]>0&&disc_index_table[drive][0x31]<3
 		&&(!memcmp("MV - CPC",disc_index_table[drive],8)||!memcmp("EXTENDED",disc_index_table[drive],8)))
-			q=0; // ID and fields are valid
+			q=disc_image_load(drive); // ID and fields are valid
 	disc_track_reset(drive);
 	if (q)
 		disc_close(drive); // unknown disc format!
-	else if (disc_path!=s)
-		strcpy(disc_path,s); // valid format
+	else
+	{
+		strcpy(disc_imagepath[drive],s);
+		if (disc_path!=s)
+			strcpy(disc_path,s); // valid format
+	}
 	return q;
 }
 
@@ -138,6 +228,25 @@ int disc_sector_size(int d,int j) // get size of sector `j` (0: first, 1: second
 	return disc_track_table[d][j*8+0x1E]+disc_track_table[d][j*8+0x1F]*256;
 }
 
+// the sectors of each track are indexed by their CHRN IDs when the track is set up,
+// so looking for a sector doesn't require checking all the sectors in the track.
+
+#define DISC_SECTOR_MAX ((512-0x18)/8) // the track info can describe up to 61 sectors
+#define DISC_SECTOR_HASH(t) (((t)[0]*3+(t)[1]*7+(t)[2]+(t)[3]*5)&63) // `t` points to CHRN
+BYTE disc_sector_hash[8][64],disc_sector_chain[8][DISC_SECTOR_MAX]; // first and next sectors (+1, 0 is none) that share a hash, in ascending order
+void disc_sector_index(int d) // index the sectors in track at unit+side `d`
+{
+	int j=disc_track_table[d][0x15];
+	if (j>DISC_SECTOR_MAX)
+		j=DISC_SECTOR_MAX;
+	MEMZERO(disc_sector_hash[d]);
+	while (j--) // backwards, so the chains are sorted
+	{
+		int h=DISC_SECTOR_HASH(&disc_track_table[d][j*8+0x18]);
+		disc_sector_chain[d][j]=disc_sector_hash[d][h],disc_sector_hash[d][h]=j+1;
+	}
+}
+
 // tracks are unique to each disc and are divided in two halves ("sides") that operate at the same time.
 
 int disc_track_load(int d,int c) // setup track `c` from drive `d`; 0 OK, !0 ERROR
@@ -146,37 +255,24 @@ int disc_track_load(int d,int c) // setup track `c` from drive `d`; 0 OK, !0 ERR
 	disc_track_table[d][0]=1; // track may be empty, but we checked it
 	if (!disc[d]||c<0||c>=disc_index_table[d][0x30]) // fail if no disc or invalid track
 		return 1;
-	int i=256; // disc header must be skipped
-	int j=c*disc_index_table[d][0x31],k;
-	if (disc_index_table[d][0]=='M') // old style
-		i+=j*(k=(disc_index_table[d][0x32]+disc_index_table[d][0x33]*256)); // all tracks are the same size, in bytes
-	else // new style
-	{
-		k=disc_index_table[d][j+0x34];
-		while (j--)
-			i+=disc_index_table[d][j+0x34]*256; // each track stores its own size, in 256-byte pages
-	}
-	fseek(disc[d],disc_track_offset[d]=i,SEEK_SET);
+	int i,j=c*disc_index_table[d][0x31],k=disc_index_table[d][0]=='M'?disc_index_table[d][0x32]+disc_index_table[d][0x33]*256:disc_index_table[d][j+0x34];
+	disc_track_offset[d]=disc_track_index[d][j];
 	if (k>1) // tracks without a body are equivalent to empty tracks!
-		fread1(disc_track_table[d],512,disc[d]); // tracks with >29 sectors use 512 bytes rather than just the first 256 bytes
+		disc_image_read(d,disc_track_offset[d],disc_track_table[d],512); // tracks with >29 sectors use 512 bytes rather than just the first 256 bytes
 	if (disc_index_table[d][0x31]>1) // is it a two-sided disc?
 	{
-		if (disc_index_table[d][0]=='M') // old style
-			i+=k; // ditto
-		else // new style
-		{
-			k=disc_index_table[d][c*disc_index_table[d][0x31]+1+0x34];
-			i+=disc_index_table[d][c*disc_index_table[d][0x31]+0x34]*256; // ditto
-		}
-		fseek(disc[d],disc_track_offset[d+4]=i,SEEK_SET);
+		if (disc_index_table[d][0]!='M') // new style
+			k=disc_index_table[d][j+1+0x34];
+		disc_track_offset[d+4]=disc_track_index[d][j+1];
 		if (k>1)
-			fread1(disc_track_table[d+4],512,disc[d]);
+			disc_image_read(d,disc_track_offset[d+4],disc_track_table[d+4],512);
 	}
 	if (disc_index_table[d][0]=='M') // old style discs lack the explicit size field and thus require calculation
 		for (k=d;k<8;k+=4) // check both sides
 			if ((i=128<<disc_track_table[k][0x14])<(128<<7)) // sector size is defined in the track header
 				for (j=0;j<disc_track_table[k][0x15];++j)
 					disc_track_table[k][j*8+0x1E]=i,disc_track_table[k][j*8+0x1F]=i>>8;
+	disc_sector_index(d),disc_sector_index(d+4);
 	//logprintf("(%08X:%08X %i:%i) ",disc_track_offset[d],disc_track_offset[d+4],disc_track_table[d][0x15],disc_track_table[d+4][0x15]);
 	return 0;
 }
@@ -191,25 +287,39 @@ int disc_sector_timer; // looking for a sector takes time; this helps simulating
 int disc_sector_find(int d) // look for sector `CHRN` in disc_parmtr[2..5] in track at unit+side `d`; 0 OK, !0 ERROR
 {
 	disc_change[d&3]=0;
-	int i=disc_track_table[d][0x15]; // number of sectors in track
+	int i,j=-1,k,n=disc_track_table[d][0x15]; // number of sectors in track
+	if (n>DISC_SECTOR_MAX)
+		n=DISC_SECTOR_MAX;
 	disc_sector_timer=1;
-	while (i--)
+	if (n)
 	{
-		if (++disc_sector_last>=disc_track_table[d][0x15])
-			disc_sector_last=0; // wrap to first sector in track
-		if (!memcmp(&disc_track_table[d][disc_sector_last*8+0x18],&disc_parmtr[2],4))
-			return 0; // CHRN match!
+		if ((k=disc_sector_last+1)>=n)
+			k=0; // the search begins after the last sector, wrapping to first sector in track
+		for (i=disc_sector_hash[d][DISC_SECTOR_HASH(&disc_parmtr[2])];i;i=disc_sector_chain[d][i-1])
+			if (!memcmp(&disc_track_table[d][(i-1)*8+0x18],&disc_parmtr[2],4)) // CHRN match!
+			{
+				if (j<0)
+					j=i-1; // the first match in track is the default
+				if (i>k)
+				{
+					j=i-1; // the first match after the last sector is the best
+					break;
+				}
+			}
+		// each sector that doesn't match takes time;
 		// this was originally a kludge for MOKTAR / TITUS THE FOX, similar but more demanding than PREHISTORIK 1 that was content by simply raising high DISC_TIMER_INIT!
 		//#define DISC_TIMER_STEP (14<<6) // rough approximation too, to make "MOKTAR / TITUS THE FOX" run on CPC.
 		//if (disc_parmtr[2]>=89&&disc_parmtr[4]==12&&disc_parmtr[5]==5&&disc_track[disc_trueunit]>=39) disc_timer+=DISC_TIMER_STEP;
-		disc_sector_timer+=2;
-		//logprintf("{%02X%02X%02X%02X} ",disc_track_table[d][disc_sector_last*8+0x18],disc_track_table[d][disc_sector_last*8+0x19],disc_track_table[d][disc_sector_last*8+0x1A],disc_track_table[d][disc_sector_last*8+0x1B]);
+		if (j>=0)
+			return disc_sector_timer+=((j-k+n)%n)*2,disc_sector_last=j,0; // CHRN match!
+		disc_sector_timer+=n*2,disc_sector_last=(k+n-1)%n; // the whole track was checked
 	}
 	if (disc_parmtr[4]==0xFF&&disc_parmtr[5]==0x00&&disc_parmtr[6]==0xFF)
 		disc_sector_last=-1; // kludge: satisfy TCOPY3 (that performs 46 00,00,00,FF,00,FF,00,80 before the first READ ID) without hurting neither DALEY TOC, 5KB DEMO 3 or DESIGN DESIGN games!
 	return 1; // sector not found!
 }
 int disc_skew_length,disc_skew_filler; // required when READ SECTOR with N > physical size forces inserting inter-sector bytes
+int disc_sector_offset; // file offset of the current sector
 void disc_sector_seek(int d,int z) // seek sector `z` (usually `disc_sector_last`) in current track at unit+side `d`; 0 OK, !0 ERROR
 {
 	disc_offset=0; // reset buffer
@@ -242,8 +352,8 @@ void disc_sector_seek(int d,int z) // seek sector `z` (usually `disc_sector_last
 			disc_lengthfull=disc_length; // set sector size
 		}
 	}
-	fseek(disc[d&3],disc_track_offset[d]+i,SEEK_SET);
-	logprintf("<%08X:%04X> ",disc_track_offset[d]+i,disc_length);
+	disc_sector_offset=disc_track_offset[d]+i;
+	logprintf("<%08X:%04X> ",disc_sector_offset,disc_length);
 }
 
 #define DISC_RESULT_LAST_CHRN() memcpy(&disc_result[3],&disc_parmtr[2],4)
@@ -293,7 +403,7 @@ void disc_sector_loadgaps(void) // used by READ TRACK
 	if (disc_sector_last>=disc_track_table[disc_trueunithead][0x15])
 		disc_sector_last=0; // wrap to first sector in track
 	disc_sector_seek(disc_trueunithead,disc_sector_last);
-	fread1(disc_buffer,disc_lengthfull,disc[disc_trueunit]); // normal case
+	disc_image_read(disc_trueunit,disc_sector_offset,disc_buffer,disc_lengthfull); // normal case
 	// UBI SOFT's discs need padding, but Batman the Movie (Spectrum +3) rejects it (?): parameter 2 is nonzero when padding must be skipped (!)
 	if (disc_length==disc_lengthfull&&!disc_parmtr[2]) // pad the length with inter-sector bytes?
 	{
@@ -351,7 +461,7 @@ void disc_sector_load(void) // read a sector and set the status flags accordingl
 				disc_sector_seek(disc_trueunithead,disc_sector_last);
 				logprintf("[RD %04X] ",disc_length);
 				disc_action|=1;
-				fread1(disc_buffer,disc_length,disc[disc_trueunit]);
+				disc_image_read(disc_trueunit,disc_sector_offset,disc_buffer,disc_length);
 				disc_delay=1,disc_phase=3;
 				disc_timer=DISC_TIMER_INIT*disc_sector_timer;
 			}
@@ -367,12 +477,11 @@ void disc_sector_load(void) // read a sector and set the status flags accordingl
 // 4.- dump the backup after the current track
 // 5.- discard the backup
 // difficult enough? if the disc is old style we also have to convert it to new style on the fly!
-// 1.- prepare a backup of the disc after the current track
-// 2.- turn the disc header into "EXTENDED" while including the new track size
-// 3.- modify all the tracks before the current one to fit the new style
-// 4.- store the new track in place of the current track
-// 5.- dump the backup after the current track while modifying the tracks into new style
-// 6.- discard the backup
+// 1.- turn the disc header into "EXTENDED" while including the new track size
+// 2.- build a new disc image with the tracks before the current one, modified to fit the new style
+// 3.- append the new track in place of the current track
+// 4.- append the tracks after the current track while modifying them into new style
+// 5.- discard the old disc image
 void disc_track_format_old2new(BYTE *t) // converts a single track from MV - CPC (old) to EXTENDED (new) style; `t` is the header
 {
 	int i,j;
@@ -424,57 +533,48 @@ void disc_track_format(void)
 			disc_track_table[disc_trueunithead][i*8+0x1F]=l>>8;
 		}
 	}
+	disc_sector_index(disc_trueunithead);
 
 	int i=0,new_offset=256,old_offset=0,old_length=0;
 	while (i<j)
 		new_offset+=disc_index_table[disc_trueunit][0x34+i++]<<8;
 	old_offset=new_offset+(q<<8);
-	if (q-=disc_index_table[disc_trueunit][j+0x34]||m) // will the file size change? did the style change? backup if required!
-		while (++i<disc_index_table[disc_trueunit][0x30]*disc_index_table[disc_trueunit][0x31])
-			old_length+=disc_index_table[disc_trueunit][0x34+i]<<8;
+	while (++i<disc_index_table[disc_trueunit][0x30]*disc_index_table[disc_trueunit][0x31])
+		old_length+=disc_index_table[disc_trueunit][0x34+i]<<8;
 
-	char *disc_backup=NULL;
-	if (old_length)
-	{
-		disc_backup=malloc(old_length);
-		fseek(disc[disc_trueunit],old_offset,SEEK_SET);
-		fread1(disc_backup,old_length,disc[disc_trueunit]);
-	}
-	fseek(disc[disc_trueunit],0,SEEK_SET);
-	fwrite1(disc_index_table[disc_trueunit],256,disc[disc_trueunit]);
-	if (m)
-		for (int i=0;i<j;++i)
-		{
-			fread1(disc_scratch,256,disc[disc_trueunit]); // load the header
-			fseek(disc[disc_trueunit],-256,SEEK_CUR); // rewind
-			disc_track_format_old2new(disc_scratch); // update header
-			fwrite1(disc_scratch,256,disc[disc_trueunit]); // save the header
-			fseek(disc[disc_trueunit],(disc_index_table[disc_trueunit][0x34+i]-1)<<8,SEEK_CUR); // next track
-		}
-	else
-		fseek(disc[disc_trueunit],new_offset,SEEK_SET);
-	if (l128)
-	{
-		fwrite1(disc_track_table[disc_trueunithead],256,disc[disc_trueunit]);
-		memset(disc_buffer,disc_parmtr[5],sizeof(disc_buffer)); // filler!
-		fwrite1(disc_buffer,((l128+1)/2)<<8,disc[disc_trueunit]);
-	}
-	if (old_length)
+	int l=new_offset+(disc_index_table[disc_trueunit][j+0x34]<<8)+old_length; BYTE *z;
+	if (z=malloc(l)) // the changes only happen in memory; if we run out of memory the disc stays as it was
 	{
+		memset(z,0,l);
+		memcpy(z,disc_index_table[disc_trueunit],256);
+		disc_image_read(disc_trueunit,256,&z[256],new_offset-256);
 		if (m)
-		{
-			int i=j,k=0;
-			while (++i<disc_index_table[disc_trueunit][0x30]*disc_index_table[disc_trueunit][0x31])
+			for (int i=0,k=256;i<j;++i)
 			{
-				disc_track_format_old2new(&disc_backup[k]); // update header
+				disc_track_format_old2new(&z[k]); // update header
 				k+=disc_index_table[disc_trueunit][0x34+i]<<8; // next track
 			}
+		if (l128)
+		{
+			memcpy(&z[new_offset],disc_track_table[disc_trueunithead],256);
+			memset(&z[new_offset+256],disc_parmtr[5],((l128+1)/2)<<8); // filler!
 		}
-		fwrite1(disc_backup,old_length,disc[disc_trueunit]);
-		free(disc_backup);
+		if (old_length)
+		{
+			disc_image_read(disc_trueunit,old_offset,&z[l-old_length],old_length);
+			if (m)
+				for (int i=j,k=l-old_length;++i<disc_index_table[disc_trueunit][0x30]*disc_index_table[disc_trueunit][0x31];)
+				{
+					disc_track_format_old2new(&z[k]); // update header
+					k+=disc_index_table[disc_trueunit][0x34+i]<<8; // next track
+				}
+		}
+		free(disc_image[disc_trueunit]);
+		disc_image[disc_trueunit]=z,disc_imagesize[disc_trueunit]=l,disc_imagedirty[disc_trueunit]=1;
 	}
-	if (q) // did the file size change? truncate!
-		fsetsize(disc[disc_trueunit],new_offset+(disc_index_table[disc_trueunit][j+0x34]<<8)+old_length);
+	else
+		memcpy(disc_index_table[disc_trueunit],disc_image[disc_trueunit],256); // undo the header changes
+	disc_image_index(disc_trueunit); // the track offsets have changed
 
 	// and it's done!
 	disc_exitstate();
@@ -754,7 +854,7 @@ void disc_data_send(BYTE b) // DATA I/O
 						disc_action|=2;
 						if (disc_canwrite[disc_trueunit])
 						{
-							fwrite(disc_buffer,1,disc_length,disc[disc_trueunit]); // warning: this silently fails if the file mode is "rb" instead of "rb+"
+							disc_image_write(disc_trueunit,disc_sector_offset,disc_buffer,disc_length);
 							// WRITE DATA (05) and WRITE DELETED DATA (09) reset and set the DELETED flag:
 							// we check whether the track header needs updating
 							int oldtag=disc_track_table[disc_trueunithead][disc_sector_last*8+0x1D],
@@ -762,8 +862,7 @@ void disc_data_send(BYTE b) // DATA I/O
 							if (oldtag!=newtag)
 							{
 								disc_track_table[disc_trueunithead][disc_sector_last*8+0x1D]=newtag;
-								fseek(disc[disc_trueunit],disc_track_offset[disc_trueunithead],SEEK_SET);
-								fwrite(disc_track_table[disc_trueunithead],1,disc_track_table[disc_trueunithead][0x15]>29?512:256,disc[disc_trueunit]); // warning: this silently fails if the file mode is "rb" instead of "rb+" (again!)
+								disc_image_write(disc_trueunit,disc_track_offset[disc_trueunithead],disc_track_table[disc_trueunithead],disc_track_table[disc_trueunithead][0x15]>29?512:256);
 							}
 						}
 						else if (!(disc_filemode&2))
@@ -18,19 +18,19 @@
 
 FILE *tape=NULL; // tape file handle
 int tape_status=0,tape_closed,tape_rewind=1; // tape signal and rewind logic
-BYTE tape_buffer[1<<12]; // tape buffer data
+BYTE tape_buffer[1<<12]; // tape buffer data, used when recording
 int tape_offset,tape_length; // tape buffer parameters
 int tape_filesize,tape_filebase,tape_filetell; // tape file stats
+
+// input tapes are kept whole in memory, so reading and seeking are just pointer operations; when the system
+// allows it the file is mapped rather than loaded, so huge WAV files don't take up their size in RAM.
+
+BYTE *tape_image=NULL; int tape_imagemap; // the tape file in memory, and whether it's mapped (!0) or allocated (0)
 INLINE int tape_fgetc(void) // reads one byte from tape. returns <0 on error!
 {
-	if (tape_offset>=tape_length) // outside cache?
-	{
-		tape_offset=0;
-		if (!(tape_length=fread(tape_buffer,1,sizeof(tape_buffer),tape)))
-			return -1;
-	}
-	++tape_filetell;
-	return tape_buffer[tape_offset++];
+	if ((unsigned)tape_filetell>=(unsigned)tape_filesize) // outside the tape?
+		return -1;
+	return tape_image[tape_filetell++];
 }
 int tape_fgetcc(void) // reads two little-endian bytes; cfr. tape_fgetc()
 {
@@ -44,24 +44,13 @@ int tape_fgetcccc(void) // reads four little-endian bytes; cfr. tape_fgetc()
 	i+=tape_fgetc()<<16;
 	return i+(tape_fgetc()<<24); // in 32-bit systems the sign will be lost!
 }
-#define tape_ungetc() (--tape_filetell,--tape_offset) // cheating the buffer!
-void tape_seek(int i) // seek to byte `i`
-{
-	if ((tape_filetell-tape_offset<=i)&&(tape_filetell-tape_offset+tape_length>=i)) // inside cache?
-	{
-		tape_offset+=i-tape_filetell;
-		tape_filetell=i;
-	}
-	else // outside cache!
-	{
-		fseek(tape,tape_filetell=i,SEEK_SET);
-		tape_offset=tape_length=0; // reset buffer!
-	}
-}
+#define tape_ungetc() (--tape_filetell) // cheating the buffer!
+#define tape_seek(i) (tape_filetell=(i)) // seek to byte `i`
 INLINE void tape_skip(int i) // skip `i` bytes; using a macro led to "gotchas" (cfr. CLANG 3.7.1)
 {
 	tape_seek(i+tape_filetell);
 }
+
 INLINE void tape_fputc(int i) // writes one byte on tape.
 {
 	tape_buffer[tape_offset]=i;
@@ -103,11 +92,131 @@ int tape_record,tape_output; // tape recording parameters
 
 char tape_path[STRMAX]="";
 
+// TZX/CDT recording keeps the pulses in memory and turns them into blocks when the tape is closed:
+// standard and turbo data blocks when the timings of the pilot, sync and bits can be told apart,
+// direct recording blocks otherwise.
+
+int *tape_pulses=NULL,tape_pulsecount,tape_pulsesize; // recorded pulses, in T units; a negative size means that the recording stopped
+void tape_pulse(int i) // store a pulse of `i` T
+{
+	if (tape_pulsecount>=tape_pulsesize)
+	{
+		int *z; if (tape_pulsesize<0||!(z=realloc(tape_pulses,sizeof(int)*(tape_pulsesize+(1<<16)))))
+		{
+			tape_pulsesize=-1; // out of memory! keep the pulses so far, but don't record any more
+			return;
+		}
+		tape_pulses=z; tape_pulsesize+=1<<16;
+	}
+	tape_pulses[tape_pulsecount++]=i;
+}
+#define TAPE_RECORD_DIRECT 79 // T per sample of direct recording blocks: 3500000/79 = 44303 Hz
+void tape_record_direct(int *p,int n,int q,int h) // write `n` pulses as a direct recording block; `q` first level, `h` pause in ms
+{
+	int i,j,k,l=0; for (i=0;i<n;++i)
+		l+=(p[i]+TAPE_RECORD_DIRECT/2)/TAPE_RECORD_DIRECT;
+	tape_fputc(0x15); tape_fputcc(TAPE_RECORD_DIRECT); tape_fputcc(h);
+	tape_fputc(l&7?l&7:8); tape_fputcc((l+7)>>3); tape_fputc((l+7)>>19);
+	for (i=k=0,l=128;i<n;++i,q^=1)
+		for (j=(p[i]+TAPE_RECORD_DIRECT/2)/TAPE_RECORD_DIRECT;j>0;--j)
+		{
+			if (q)
+				k|=l;
+			if (!(l>>=1))
+				tape_fputc(k),k=0,l=128;
+		}
+	if (l<128)
+		tape_fputc(k);
+}
+int tape_record_alike(int i,int j,int d) // TRUE if `i` is within `j`/`d` of `j`
+{
+	return (i>j?i-j:j-i)*d<=j;
+}
+void tape_record_block(int *p,int n,int q,int h) // write `n` pulses as the best block; `q` first level, `h` pause in ms
+{
+	int i,j,k,l,m,b0=0,b1=0,c0=0,c1=0,t;
+	for (i=1;i<n&&tape_record_alike(p[i],p[1],8);++i) ; // PILOT: the first pulse may be partial, so it isn't the reference
+	if (i>=256&&(m=(n-i-2)>>1)>=8) // long enough PILOT, two SYNCS and pairs of pulses; a last odd pulse is part of the pause
+	{
+		int *d=&p[i+2];
+		for (l=d[0],k=j=0;j<m*2;++j) // find the shortest and longest pulses
+			if (l>d[j])
+				l=d[j];
+			else if (k<d[j])
+				k=d[j];
+		if (k*2<l*3) // all the bits are the same; compare them with the PILOT
+			t=l*10>=p[1]*7?0:k*2; // all ONE (`t` below any pulse) or all ZERO (`t` above any pulse)
+		else
+			t=(k+l)/2;
+		for (j=0;j<m*2;j+=2) // all bits must be pairs of pulses of the same kind
+			if ((d[j]<t)!=(d[j+1]<t))
+				break;
+			else if (d[j]<t)
+				b0+=d[j]+d[j+1],c0+=2;
+			else
+				b1+=d[j]+d[j+1],c1+=2;
+		if (j>=m*2)
+		{
+			if (c0) b0=(b0+c0/2)/c0; else b0=b1/c1/2; // the missing length is guessed
+			if (c1) b1=(b1+c1/2)/c1; else b1=b0*2;
+			for (j=0;j<m*2;++j)
+				if (!tape_record_alike(d[j],d[j]<t?b0:b1,4))
+					break;
+		}
+		if (j>=m*2&&i<65536&&p[1]<50000&&d[-2]<65536&&d[-1]<65536&&b1<65536) // valid bits that fit in a block!
+		{
+			for (l=0,j=1;j<i;++j) // average PILOT length
+				l+=p[j];
+			l=(l+(i-1)/2)/(i-1);
+			if (!(m&7)&&m<(65536<<3)&&tape_record_alike(l,2168,16)&&tape_record_alike(d[-2],667,6)&&tape_record_alike(d[-1],735,6)
+				&&tape_record_alike(b0,855,8)&&tape_record_alike(b1,1710,8)&&tape_record_alike(i,d[0]<t?8063:3223,16))
+			{
+				tape_fputc(0x10); tape_fputcc(h); tape_fputcc(m>>3); // STANDARD DATA
+			}
+			else
+			{
+				tape_fputc(0x11); tape_fputcc(l); // TURBO DATA
+				tape_fputcc(d[-2]); tape_fputcc(d[-1]); tape_fputcc(b0); tape_fputcc(b1);
+				tape_fputcc(i); tape_fputc(m&7?m&7:8); tape_fputcc(h);
+				tape_fputcc((m+7)>>3); tape_fputc((m+7)>>19);
+			}
+			for (k=j=0;j<m;++j) // build the bytes, highest bits first
+			{
+				k+=k+(d[j*2]>=t);
+				if (!(~j&7)) // 8 bits?
+					tape_fputc(k),k=0;
+			}
+			if (m&7)
+				tape_fputc(k<<(8-(m&7)));
+			return;
+		}
+	}
+	tape_record_direct(p,n,q,h);
+}
+#define TAPE_RECORD_GAP (3500*10) // pulses longer than 10 ms end the blocks
+void tape_record_blocks(void) // turn all the recorded pulses into blocks
+{
+	int i,j,h;
+	for (i=j=0;i<tape_pulsecount;++i)
+		if (tape_pulses[i]>=TAPE_RECORD_GAP)
+		{
+			if ((h=tape_pulses[i]/3500)>65535)
+				h=65535;
+			if (i>j) // skip the silence before the first block
+				tape_record_block(&tape_pulses[j],i-j,j&1,h);
+			j=i+1;
+		}
+	if (i>j)
+		tape_record_block(&tape_pulses[j],i-j,j&1,0);
+}
+
 void tape_flush(void) // dump remaining samples, if any
 {
 	if (tape_count)
 	{
-		if (tape_count<256)
+		if (tape_type<-1) // TZX/CDT?
+			tape_pulse(tape_count*TAPE_MAIN_TZX_STEP);
+		else if (tape_count<256)
 			tape_fputc(tape_count);
 		else
 			tape_fputc(0),tape_fputcccc(tape_count);
@@ -116,26 +225,332 @@ void tape_flush(void) // dump remaining samples, if any
 	}
 }
 
-void tape_close(void) // close tape file
+// tapes are indexed just once when they're opened: each entry keeps the file offset, the playback time
+// and the type of a block, so browsing the tape doesn't need reading it again from the beginning and
+// any block (or any moment) can be reached at once. WAV and CSW tapes are split in twenty even parts.
+
+int *tape_blocks=NULL,*tape_blocktimes=NULL,tape_blockcount; // file offsets and playback times (in `tape_playback` units) of the blocks, plus the end of the tape
+BYTE *tape_blocktypes=NULL; // block IDs (zero in WAV and CSW) plus the signal before the block begins (bit 7)
+int tape_block_room(int n) // make room for `n` entries; 0 OK, !0 ERROR
+{
+	int *z; BYTE *y;
+	if (!(z=realloc(tape_blocks,sizeof(int)*n)))
+		return 1;
+	tape_blocks=z;
+	if (!(z=realloc(tape_blocktimes,sizeof(int)*n)))
+		return 1;
+	tape_blocktimes=z;
+	if (!(y=realloc(tape_blocktypes,n)))
+		return 1;
+	return tape_blocktypes=y,0;
+}
+int tape_block_find(int o) // returns the block that holds the offset `o`
+{
+	int i=0,j=tape_blockcount,k;
+	while (j-i>1)
+		if (tape_blocks[k=(i+j)>>1]>o)
+			j=k;
+		else
+			i=k;
+	return i;
+}
+
+// the tape telemetry counts the bytes that the speed-up hacks took from the tape and the ones that the Z80
+// had to read from the signal, the emulated frames and the host time spent on each block, and the places
+// that polled the tape without matching any known loader; the debugger and the `-y` option show them.
+
+int tape_stats_traps=0,tape_stats_misses=0,tape_stats_dumped=0,tape_stats_fed=0,tape_stats_bytes=0; // global counters
+int *tape_stats_frames=NULL; long long *tape_stats_clocks=NULL,tape_stats_clock=0; // per block counters
+#define TAPE_STATS_PCS 16
+int tape_stats_pc[TAPE_STATS_PCS],tape_stats_pcs[TAPE_STATS_PCS],tape_stats_pcn=0; // addresses and their polls
+int tape_block_ones(int b) // count the bits set among the next `b` bits, highest bits first; the offset doesn't change
+{
+	int i,n=0,o=tape_filetell;
+	for (;b>0;b-=8)
+	{
+		if ((i=tape_fgetc())<0)
+			break;
+		if (b<8)
+			i&=0xFF00>>b; // only the highest bits of the last byte
+		for (;i;i&=i-1)
+			++n;
+	}
+	return tape_seek(o),n;
+}
+long long tape_block_bits(int b,int b0,int b1) // length of the next `b` bits, two pulses each
+{
+	int n=tape_block_ones(b);
+	return 2LL*(b-n)*b0+2LL*n*b1;
+}
+long long tape_block_general(int n,int m,int a,int d,int *q) // length of `n` items made of `a` symbols of up to `m` pulses; `d` is the bits per symbol, or zero for PILOT items (symbol and count); `q` is the signal
+{
+	int i,j,b=0,r,l[256],f[256],z[256]; long long t=0; // length, polarity and pulses of each symbol
+	if (n<=0)
+		return 0; // no definitions, no items
+	for (i=0;i<a;++i) // symbol definitions
+		for (f[i]=tape_fgetc()&3,l[i]=z[i]=j=0;j<m;++j)
+			if ((r=tape_fgetcc())>0&&z[i]==j) // a zero ends the symbol
+				l[i]+=r,++z[i];
+	for (j=8;n>0;--n) // items
+	{
+		if (d) // DATA: `d` bits per symbol, highest bits first
+		{
+			if (j+d>8)
+				b=tape_fgetc(),j=0;
+			i=(b>>(8-(j+=d)))&((1<<d)-1),r=1;
+		}
+		else // PILOT: symbol and count
+			i=tape_fgetc()&255,r=tape_fgetcc();
+		if (i<a&&r>0&&z[i])
+		{
+			t+=(long long)r*l[i];
+			if (f[i]>=2) // forced signal
+				*q=(f[i]&1)^((z[i]-1)&1);
+			else // the first pulse toggles the signal unless told otherwise
+				*q^=(r*(z[i]-f[i]))&1;
+		}
+	}
+	return t;
+}
+void tape_block_index(void) // index the current tape
+{
+	int a,b,c,d,e,f,i,j,k,l,h,o,n=0,q=0,r=0; long long t=0,u=0; // `q` is the signal, `r` and `u` follow the loops
+	tape_blockcount=0;
+	if (tape_type<2) // CSW, or WAV after slicing?
+	{
+		if (tape_block_room(21))
+			return; // out of memory!
+		for (q=tape_status,tape_seek(tape_filebase);;) // the first pulse toggles the signal
+		{
+			while (n<20&&tape_filetell>=tape_filebase+(long long)n*(tape_filesize-tape_filebase)/20)
+				tape_blocks[n]=tape_filetell,tape_blocktimes[n]=t,tape_blocktypes[n++]=q<<7;
+			if ((i=tape_fgetc())<0)
+				break; // end of tape
+			if (!i)
+				i=tape_fgetcccc();
+			if (i>0)
+				t+=i;
+			q^=1;
+		}
+		tape_blocks[n]=tape_filesize; tape_blocktimes[n]=t;
+		tape_blockcount=n;
+	}
+	else // TZX/CDT or TAP
+	{
+		t=2000*3500; // the HOLD before the first block
+		for (tape_seek(tape_filebase);;)
+		{
+			if (tape_blockcount>=n-1&&tape_block_room(n+=256)) // keep room for the final entry
+				break; // out of memory!
+			tape_blocktimes[tape_blockcount]=t/TAPE_MAIN_TZX_STEP; tape_blocktypes[tape_blockcount]=q<<7;
+			if ((tape_blocks[tape_blockcount]=tape_filetell)>=tape_filesize||(tape_blockcount&&tape_filetell<=tape_blocks[tape_blockcount-1]))
+				break; // end of tape, or a corrupt block
+			h=0; // HOLD after the block, in milliseconds
+			#ifdef TAPE_OPEN_TAP_FORMAT
+			if (tape_type==3) // TAP
+			{
+				l=tape_fgetcc(); i=0x10; h=2000;
+				j=tape_filetell<tape_filesize&&(tape_image[tape_filetell]&128)?3223:8063;
+				t+=2168LL*j+667+735+tape_block_bits(l<<3,855,1710); q^=j&1;
+			}
+			else // TZX/CDT
+			#endif
+				switch (l=0,i=tape_fgetc())
+				{
+					case 0x10: // STANDARD DATA
+						h=tape_fgetcc(); l=tape_fgetcc();
+						j=tape_filetell<tape_filesize&&(tape_image[tape_filetell]&128)?3223:8063;
+						t+=2168LL*j+667+735+tape_block_bits(l<<3,855,1710); q^=j&1;
+						break;
+					case 0x11: // TURBO DATA
+						a=tape_fgetcc(); b=tape_fgetcc(); c=tape_fgetcc(); // PILOT and SYNC lengths
+						d=tape_fgetcc(); e=tape_fgetcc(); j=tape_fgetcc(); // BIT lengths and PILOT count
+						k=tape_fgetc()-8; h=tape_fgetcc(); l=tape_fgetcc(); l+=tape_fgetc()<<16;
+						t+=(long long)a*j+b+c+tape_block_bits((l<<3)+k,d,e); q^=j&1;
+						break;
+					case 0x12: // PURE TONE
+						a=tape_fgetcc(); j=tape_fgetcc(); t+=(long long)a*j; q^=j&1;
+						break;
+					case 0x13: // PURE SYNC
+						for (k=j=tape_fgetc();k>0;--k)
+							t+=tape_fgetcc();
+						q^=j&1;
+						break;
+					case 0x14: // PURE DATA
+						d=tape_fgetcc(); e=tape_fgetcc();
+						k=tape_fgetc()-8; h=tape_fgetcc(); l=tape_fgetcc(); l+=tape_fgetc()<<16;
+						t+=tape_block_bits((l<<3)+k,d,e);
+						break;
+					case 0x15: // SAMPLES
+						a=tape_fgetcc(); h=tape_fgetcc();
+						if ((k=tape_fgetc()-8)==-8) k=0; // handle dodgy VALLATION TURBO tape!
+						l=tape_fgetcc(); l+=tape_fgetc()<<16;
+						if ((k+=l<<3)>0) // the signal is the last sample
+							t+=(long long)a*k--,q=tape_filetell+(k>>3)<tape_filesize&&(tape_image[tape_filetell+(k>>3)]&(128>>(k&7)));
+						break;
+					case 0x19: // GENERALIZED DATA
+						l=tape_fgetcccc(); o=tape_filetell;
+						h=tape_fgetcc(); a=tape_fgetcccc(); b=tape_fgetc(); if (!(c=tape_fgetc())) c=256;
+						d=tape_fgetcccc(); e=tape_fgetc(); if (!(f=tape_fgetc())) f=256;
+						t+=tape_block_general(a,b,c,0,&q); // PILOT
+						t+=tape_block_general(d,e,f,f>2?f>4?f>16?8:4:2:1,&q); // DATA
+						tape_seek(o);
+						break;
+					case 0x20: h=tape_fgetcc(); break; // HOLD (or STOP)
+					case 0x2A: l=4; break; // STOP if 48K
+					case 0x21: l=tape_fgetc(); break; // GROUP START
+					case 0x22: case 0x27: break; // GROUP END, !RETURN FROM CALL
+					case 0x24: r=tape_fgetcc(); u=t; break; // LOOP START
+					case 0x25: if (r>1) t+=(t-u)*(r-1); r=0; break; // LOOP END
+					case 0x23: l=2; break; // !JUMP TO GROUP
+					case 0x26: l=tape_fgetc()*2; break; // !CALL SEQUENCE
+					case 0x28: case 0x32: l=tape_fgetcc(); break; // !SELECT BLOCK, *ARCHIVE INFO
+					case 0x31: tape_fgetc(); // *MESSAGE BLOCK; no `break`!
+					case 0x30: l=tape_fgetc(); break; // *TEXT DESCRIPTION
+					case 0x33: l=tape_fgetc()*3; break; // *HARDWARE TYPE
+					case 0x34: l=8; break; // *EMULATION INFO
+					case 0x35: tape_skip(16); l=tape_fgetcccc(); break; // *CUSTOM INFO
+					case 0x40: l=tape_fgetcccc()>>8; break; // *SNAPSHOT INFO
+					#ifdef TAPE_KANSAS_CITY
+					case 0x4B: // KANSAS CITY STANDARD
+						l=tape_fgetcccc(); o=tape_filetell;
+						h=tape_fgetcc(); a=tape_fgetcc(); j=tape_fgetcc(); t+=(long long)a*j; q^=j&1; // PILOT
+						d=tape_fgetcc(); e=tape_fgetcc(); // BIT lengths
+						if (!(b=(k=tape_fgetc())>>4)) b=16; // pulses per BIT 0
+						if (!(c=k&15)) c=16; // pulses per BIT 1
+						k=tape_fgetc(); f=l-12; // flags and bytes
+						j=((k>>6)&3)*(k&32?c:b); a=((k>>3)&3)*(k&4?c:b); // IN and OUT pulses per byte
+						t+=(long long)f*(j*(k&32?e:d)+a*(k&4?e:d));
+						j=f*(j+a); k=tape_block_ones(f<<3); f=(f<<3)-k; // pulses of IN and OUT, BITS 1 and BITS 0
+						t+=(long long)k*c*e+(long long)f*b*d; q^=(j+k*c+f*b)&1;
+						tape_seek(o);
+						break;
+					#endif
+					case 0x5A: l=9; break; // *GLUE
+					default: l=tape_fgetcccc(); break; // *UNKNOWN! blocks are defined this way
+				}
+			if (h>0) // the HOLD ends on a low signal
+				t+=3500LL*h,q=0;
+			tape_blocktypes[tape_blockcount]|=i&127;
+			tape_skip(l);
+			++tape_blockcount;
+		}
+	}
+	tape_seek(tape_filebase);
+	if (tape_blockcount&&(tape_stats_frames=calloc(tape_blockcount,sizeof(int))))
+		if (!(tape_stats_clocks=calloc(tape_blockcount,sizeof(long long))))
+			free(tape_stats_frames),tape_stats_frames=NULL;
+}
+unsigned int tape_hash(void) // returns the CRC32 of the blocks of the current tape, without the header
+{
+	return tape_image?~puff_dohash(~0,&tape_image[tape_filebase],tape_filesize-tape_filebase):0;
+}
+
+// WAV tapes are sliced just once when they're opened: the channels of each frame are mixed, the DC offset
+// is removed and a Schmitt trigger following the signal's envelope finds the edges; the lengths between
+// them become a CSW1 pulse stream that tape_main() plays like any other CSW file.
+
+int tape_wave_slice(int l,int n,int m) // slice `l` bytes of frames of `n` channels of `m` bytes each; 0 OK, !0 ERROR
+{
+	if (l>tape_filesize-tape_filetell)
+		l=tape_filesize-tape_filetell; // truncated WAV!
+	if (n<1||m<1||n*m>tape_sync||(l/=tape_sync)<1)
+		return 1; // bad format!
+	BYTE *s=&tape_image[tape_filetell],*t=NULL,*u;
+	int i,j,k,d=0,e=0,h,o=0,p=-1,r=0,z=0,y=0; // DC offset, envelope, hysteresis, output, last output, pulse and buffer
+	for (k=0;(tape_playback>>k)>64;++k) ; // time constant of the DC and envelope filters, ~10-15 ms
+	for (i=0;i<=l;++i,s+=tape_sync)
+	{
+		if (i<l)
+		{
+			int x=0,w;
+			if (m<2) // 8-bit samples are unsigned
+				for (j=0;j<n;++j)
+					x+=(s[j]-128)<<8;
+			else // longer samples are signed; their top 16 bits are enough
+				for (j=m-2;j<n*m;j+=m)
+					x+=s[j]+((signed char)s[j+1]<<8);
+			d+=w=x-(d>>k); // `w` is the signal without DC
+			if (e<(x=w<0?-w:w))
+				e=x;
+			else
+				e-=e>>k;
+			if ((h=e>>3)<(n<<8))
+				h=n<<8; // noise floor
+			if (w>h)
+				o=1;
+			else if (w<-h)
+				o=0;
+		}
+		if (i>=l||o!=p) // edge, or end of tape?
+		{
+			if (p<0) // the first pulse toggles the signal
+				tape_status=!o;
+			else
+			{
+				if (z+5>y) // the pulses are much fewer than the frames, but we cannot tell how many
+				{
+					if (!(u=realloc(t,y+=(y>>1)+(1<<16))))
+						return free(t),1; // out of memory!
+					t=u;
+				}
+				if (r<256)
+					t[z++]=r;
+				else
+					t[z++]=0,mputiiii(&t[z],r),z+=4;
+			}
+			p=o; r=0;
+		}
+		++r;
+	}
+	if (tape_imagemap)
+		session_unmapfile(tape_image,tape_filesize);
+	else
+		free(tape_image);
+	if (u=realloc(t,z)) // give back the unused room
+		t=u;
+	tape_image=t; tape_imagemap=0;
+	tape_filesize=z; tape_filetell=tape_count=0; tape_type=1;
+	return 0;
+}
+
+int tape_close(void) // close tape file; 0 OK, !0 ERROR (the recording is incomplete)
 {
+	int q=0;
 	if (tape)
 	{
 		if (tape_type<0) // recording?
-			tape_flush(),fwrite(tape_buffer,1,tape_offset,tape); // finish and record last sample
+		{
+			tape_flush(); // finish and record last sample
+			if (tape_type<-1) // TZX/CDT?
+				q=tape_pulsesize<0,tape_record_blocks();
+			q|=fwrite(tape_buffer,1,tape_offset,tape)!=tape_offset;
+		}
 		puff_fclose(tape);
 	}
-	tape=NULL;
+	if (tape_image)
+	{
+		if (tape_imagemap)
+			session_unmapfile(tape_image,tape_filesize);
+		else
+			free(tape_image);
+	}
+	if (tape_blocks)
+		free(tape_blocks),free(tape_blocktimes),free(tape_blocktypes);
+	if (tape_stats_frames)
+		free(tape_stats_frames),free(tape_stats_clocks);
+	if (tape_pulses)
+		free(tape_pulses);
+	tape=NULL; tape_image=NULL; tape_blocks=tape_blocktimes=tape_stats_frames=NULL; tape_blocktypes=NULL; tape_stats_clocks=NULL; tape_pulses=NULL; tape_blockcount=tape_pulsecount=tape_pulsesize=0;
 	tape_filesize=tape_filetell=tape_mask=tape_type=tape_status=0;
+	return q;
 }
 
 int tape_endoftape(void) // rewind tape, if possible; 0 OK, !0 ERROR
 {
 	if (tape_rewind&&!tape_closed++) // close anyway if two loops happen at once (i.e. corrupt tape)
 		if (tape_type>=0) // only rewind on INPUT tapes!
-		{
-			fseek(tape,tape_filetell=tape_filebase,SEEK_SET);
-			return tape_offset=tape_length=0; // reset buffer!
-		}
+			return tape_filetell=tape_filebase,0;
 	return tape_close(),++tape_closed; // cannot rewind!
 }
 
@@ -144,7 +559,7 @@ int tape_open(char *s) // open a tape file. `s` path; 0 OK, !0 ERROR
 	tape_close();
 	if (!(tape=puff_fopen(s,"rb")))
 		return 1; // cannot open tape!
-	int q=1,l; // temporary integer and error flag
+	int q=1,l,n=0,m=0; // temporary integers and error flag
 	tape_closed=tape_offset=tape_length=tape_bits=tape_playback=0; // reset buffer!
 	if (fread(tape_buffer,1,8,tape)==8) // guess the format
 	{
@@ -157,7 +572,8 @@ int tape_open(char *s) // open a tape file. `s` path; 0 OK, !0 ERROR
 					{
 						l-=fread(tape_buffer,1,16,tape); // read the first part of the "fmt " chunk
 						tape_playback=tape_buffer[4]+(tape_buffer[5]<<8)+(tape_buffer[6]<<16);
-						tape_sync=tape_buffer[12]; // handle any bit depth and channel amount: only the highest bit matters to us
+						tape_sync=tape_buffer[12]; // frame size
+						n=tape_buffer[2]; m=(tape_buffer[14]+7)>>3; // channels and bytes per sample
 					}
 					fseek(tape,l,SEEK_CUR); // skip unknown chunk!
 				}
@@ -195,8 +611,16 @@ int tape_open(char *s) // open a tape file. `s` path; 0 OK, !0 ERROR
 	}
 	if (q)
 		return tape_close(),1; // unknown tape format!
-	tape_filetell=ftell(tape); fseek(tape,0,SEEK_END); tape_filesize=ftell(tape); fseek(tape,tape_filetell,SEEK_SET);
-	tape_filebase=tape_filetell+=tape_offset-tape_length;
+	tape_filetell=ftell(tape); fseek(tape,0,SEEK_END);
+	if ((tape_filesize=ftell(tape))<=0)
+		return tape_close(),1; // cannot load tape!
+	if (!(tape_imagemap=!!(tape_image=session_mapfile(tape,tape_filesize))))
+		if (tape_image=malloc(tape_filesize)) // cannot map it, load it
+			fseek(tape,0,SEEK_SET),tape_filesize=fread1(tape_image,tape_filesize,tape);
+	if (!tape_image||(!tape_type&&tape_wave_slice(l,n,m)))
+		return tape_close(),1; // cannot load tape!
+	tape_filebase=tape_filetell-=tape_length; // TAP files don't have a header
+	tape_block_index();
 	if (tape_path!=s)
 		strcpy(tape_path,s); // valid format
 	return 0;
@@ -206,8 +630,10 @@ int tape_create(char *s) // create a tape file. `s` path; 0 OK, !0 ERROR
 	tape_close();
 	if (!(tape=puff_fopen(s,"wb")))
 		return 1; // cannot create tape!
-	fwrite("Compressed Square Wave\032\001\001\104\254\001\000\000\000\000",1,32,tape); // 44100Hz CSW1 format
-	tape_playback=44100; tape_type=-1;
+	if (multiglobbing("*.cdt;*.tzx",s,1))
+		fwrite("ZXTape!\032\001\024",1,10,tape),tape_playback=3500000/TAPE_MAIN_TZX_STEP,tape_type=-2; // TZX 1.20 format
+	else
+		fwrite("Compressed Square Wave\032\001\001\104\254\001\000\000\000\000",1,32,tape),tape_playback=44100,tape_type=-1; // 44100Hz CSW1 format
 	if (tape_path!=s)
 		strcpy(tape_path,s); // why not?
 	return tape_filesize=tape_filetell=tape_offset=tape_count=tape_record=tape_output=0; // reset buffer and format
@@ -253,15 +679,8 @@ void tape_main(int t) // handle tape signal for `t` clock ticks
 		return;
 	switch (tape_type) // `while` is inside `switch` because the tape type won't change inside the loop!
 	{
-		case 0: // WAV
-			tape_skip(tape_sync*p-1); // avoid bugs caused by `tape_wave` getting modified by tape_select()
-			if ((tape_status=tape_fgetc())<0) // EOF?
-				if (tape_endoftape())
-					return; // quit!
-			tape_status=tape_status>128;
-			break;
-		case 1: // CSW
-			while (p--)
+		case 1: // CSW, or WAV after slicing
+			while (p>0) // pulses are skipped whole, rather than step by step
 			{
 				if (!tape_count)
 				{
@@ -275,18 +694,24 @@ void tape_main(int t) // handle tape signal for `t` clock ticks
 						tape_count=tape_fgetcccc();
 					tape_status^=1;
 				}
-				--tape_count;
+				int i=tape_count>0&&tape_count<p?tape_count:p; // broken pulses (<=0) take the remainder
+				tape_count-=i; p-=i;
 			}
 			break;
 		case 2: // TZX/CDT
 		case 3: // TAP
-			while (p--)
+			while (p>0) // the signal only changes on edges: skip whole pulses rather than single steps
 			{
 				while (tape_count<1)
 				{
 					// handle current block, if any
-					if (tape_pilots) // TONE?
-						tape_status^=1,--tape_pilots,tape_count+=tape_pilot;
+					if (tape_pilots) // TONE? add all the pulses that will be over before the last step
+					{
+						int i=tape_pilot>0?((p-1)*TAPE_MAIN_TZX_STEP-tape_count)/tape_pilot+1:1;
+						if (i>tape_pilots)
+							i=tape_pilots;
+						tape_status^=i&1,tape_pilots-=i,tape_count+=tape_pilot*i;
+					}
 					else if (tape_syncs) // SYNC?
 						tape_status^=1,--tape_syncs,tape_count+=tape_syncz[tape_sync++];
 					else if (tape_bits) // BITS?
@@ -294,7 +719,7 @@ void tape_main(int t) // handle tape signal for `t` clock ticks
 						if (!tape_half) // first half, calculate length
 						{
 							if (!(tape_mask>>=1)) // no bits left?
-								tape_mask=128,tape_byte=tape_fgetc();
+								tape_mask=128,tape_byte=tape_fgetc(),++tape_stats_bytes;
 							tape_count+=tape_half=tape_mask&tape_byte?tape_bit1:tape_bit0;
 						}
 						else // second half, same length as first half
@@ -356,7 +781,7 @@ void tape_main(int t) // handle tape signal for `t` clock ticks
 								tape_general_mask=(1<<(tape_general_bits=tape_general_asd>2?tape_general_asd>4?tape_general_asd>16?8:4:2:1))-1,
 								tape_main_general_make(tape_general_asd,tape_general_npd),tape_general_asd=0;
 							// can tape_general_bits ever be zero!?
-							tape_main_general_load(((tape_byte=tape_fgetc())>>(tape_general_step=(tape_general_count=8)-tape_general_bits))&tape_general_mask);
+							tape_main_general_load(((tape_byte=tape_fgetc())>>(tape_general_step=(tape_general_count=8)-tape_general_bits))&tape_general_mask),++tape_stats_bytes;
 						}
 						if (tape_main_general_next()) // end of symbol?
 							if (--tape_general_totd)
@@ -365,11 +790,15 @@ void tape_main(int t) // handle tape signal for `t` clock ticks
 					}
 					else if (tape_hold) // HOLD?
 					{
-						tape_count+=3500;
 						if (tape_hold>0)
-							tape_status^=1,tape_hold=1-tape_hold;
-						else
-							tape_status=0,++tape_hold;
+							tape_status^=1,tape_hold=1-tape_hold,tape_count+=3500;
+						else // silence: like TONE, add all the milliseconds that will be over before the last step
+						{
+							int i=((p-1)*TAPE_MAIN_TZX_STEP-tape_count)/3500+1;
+							if (i>-tape_hold)
+								i=-tape_hold;
+							tape_status=0,tape_hold+=i,tape_count+=3500*i;
+						}
 					}
 					// fetch new blocks if required
 					#ifdef TAPE_OPEN_TAP_FORMAT
@@ -583,10 +1012,14 @@ void tape_main(int t) // handle tape signal for `t` clock ticks
 							//if (x) logprintf("TZX: BLOCK 0x%02X!\n",x);
 						}
 				}
-				tape_count-=TAPE_MAIN_TZX_STEP;
+				int i=(tape_count-1)/TAPE_MAIN_TZX_STEP+1; // steps until the next edge
+				if (i>p)
+					i=p;
+				tape_count-=TAPE_MAIN_TZX_STEP*i; p-=i;
 			}
 			break;
 		case -1: // recording to CSW
+		case -2: // recording to TZX/CDT
 			if (tape_record!=tape_output)
 				tape_flush();
 			tape_count+=p;
@@ -603,7 +1036,8 @@ void tape_catalog_text(char **t,int i)
 			*(*t)++=j; // purge invisible chars (f.e. SPEEDKING.CDT)
 	*(*t)++=0;
 }
-#define TAPE_CATALOG_HEAD "%010i --"
+#define TAPE_CATALOG_HEAD "%010i %3i:%02i --"
+#define TAPE_CATALOG_TIME(n) tape_blocktimes[n]/tape_playback/60,tape_blocktimes[n]/tape_playback%60 // minutes and seconds
 int tape_catalog(char *t,int x)
 {
 	if (!tape||tape_type<0)
@@ -611,37 +1045,35 @@ int tape_catalog(char *t,int x)
 	int i,j,p=-1;
 	if (tape_type<2) // sample?
 	{
-		int x=tape_type?-1:-tape_sync; // WAV granularity depends on sample width
-		for (i=0;i<100;i+=5)
+		for (i=0;i<tape_blockcount;++i)
 		{
-			j=tape_filebase+(((long long)i*(tape_filesize-tape_filebase)/100)&x);
-			if (j<=tape_filetell)
+			if ((j=tape_blocks[i])<=tape_filetell)
 				++p;
-			t+=1+sprintf(t,TAPE_CATALOG_HEAD " sample block %02i%%",j,i);
+			t+=1+sprintf(t,TAPE_CATALOG_HEAD " sample block %02i%%",j,TAPE_CATALOG_TIME(i),i*100/tape_blockcount);
 		}
 	}
 	else // TZX/TAP?
 	{
 		char *s=&t[x-STRMAX],*u=NULL;
-		int z=tape_filetell,k,l;
-		tape_seek(tape_filebase);
+		int z=tape_filetell,n=0,l;
 		#ifdef TAPE_OPEN_TAP_FORMAT
 		if (tape_type==3) // TAP
-			while (t<s&&(i=tape_fgetcc())>=0)
+			for (;t<s&&n<tape_blockcount;++n)
 			{
-				t+=1+sprintf(t,TAPE_CATALOG_HEAD " STANDARD DATA, %i bytes",j=tape_filetell-2,i);
+				j=tape_blocks[n]; // don't set and read `j` within the same argument list
+				t+=1+sprintf(t,TAPE_CATALOG_HEAD " STANDARD DATA, %i bytes",j,TAPE_CATALOG_TIME(n),tape_blocks[n+1]-j-2);
 				if (j<=z)
 					++p;
-				tape_skip(i);
 			}
 		else // TZX/CDT
 		#endif
-			while (t<s&&(i=tape_fgetc())>=0)
+			for (;t<s&&n<tape_blockcount;++n)
 			{
-				t+=sprintf(t,TAPE_CATALOG_HEAD " ",j=tape_filetell-1);
+				tape_seek(tape_blocks[n]); i=tape_fgetc();
+				t+=sprintf(t,TAPE_CATALOG_HEAD " ",j=tape_blocks[n],TAPE_CATALOG_TIME(n));
 				if (j<=z&&!u)
 					++p;
-				k=l=0;
+				l=0;
 				switch (i)
 				{
 					case 0x10: t+=1+sprintf(t,"STANDARD DATA");
@@ -654,7 +1086,6 @@ int tape_catalog(char *t,int x)
 						l+=tape_fgetc()<<16;
 						break;
 					case 0x12: t+=1+sprintf(t,"PURE TONE");
-						tape_skip(2+2);
 						break;
 					case 0x13: t+=1+sprintf(t,"PURE SYNC");
 						l=tape_fgetc()<<1;
@@ -670,14 +1101,11 @@ int tape_catalog(char *t,int x)
 						l+=tape_fgetc()<<16;
 						break;
 					case 0x19: t+=1+sprintf(t,"GENERAL DATA");
-						l=tape_fgetcccc();
-						l-=(k=2+4+1+1+4+1+1);
+						l=tape_fgetcccc()-(2+4+1+1+4+1+1);
 						break;
 					case 0x20: t+=1+sprintf(t,"HOLD");
-						tape_fgetcc();
 						break;
 					case 0x2A: t+=1+sprintf(t,"STOP on 48K");
-						tape_fgetcccc();
 						break;
 					case 0x21: t+=sprintf(t,"GROUP: "); // GROUP START
 						tape_catalog_text(&t,tape_fgetc());
@@ -686,20 +1114,16 @@ int tape_catalog(char *t,int x)
 					case 0x22: if (u) t=u,u=NULL; // t+=1+sprintf(t,"GROUP END");
 						break;
 					case 0x23: t+=1+sprintf(t,"!JUMP TO GROUP");
-						tape_fgetcc();
 						break;
 					case 0x24: t+=1+sprintf(t,"LOOP START");
-						tape_fgetcc();
 						break;
 					case 0x25: t+=1+sprintf(t,"LOOP END");
 						break;
 					case 0x26: t+=1+sprintf(t,"!CALL SEQUENCE");
-						k=tape_fgetc()*2;
 						break;
 					case 0x27: t+=1+sprintf(t,"!RETURN FROM CALL");
 						break;
 					case 0x28: t+=1+sprintf(t,"!SELECT BLOCK");
-						k=tape_fgetcc();
 						break;
 					case 0x31: // *MESSAGE BLOCK
 						tape_fgetc(); // no `break`!
@@ -707,43 +1131,33 @@ int tape_catalog(char *t,int x)
 						tape_catalog_text(&t,tape_fgetc());
 						break;
 					case 0x32: t+=1+sprintf(t,"*ARCHIVE INFO");
-						k=tape_fgetcc();
 						break;
 					case 0x33: t+=1+sprintf(t,"*HARDWARE TYPE");
-						k=tape_fgetc()*3;
 						break;
 					case 0x34: t+=1+sprintf(t,"*EMULATION INFO");
-						k=8;
 						break;
 					case 0x35: t+=1+sprintf(t,"*CUSTOM INFO");
-						tape_skip(16);
-						k=tape_fgetcccc();
 						break;
 					case 0x40: t+=1+sprintf(t,"*SNAPSHOT INFO");
-						k=tape_fgetcccc()>>8;
 						break;
 					#ifdef TAPE_KANSAS_CITY
 					case 0x4B: t+=1+sprintf(t,"KANSAS CITY DATA");
-						k=tape_fgetcccc();
-						l=k-12;
+						l=tape_fgetcccc()-12;
 						break;
 					#endif
 					case 0x5A: t+=1+sprintf(t,"*GLUE");
-						k=9;
 						break;
 					default: t+=1+sprintf(t,"*UNKNOWN!");
-						k=tape_fgetcccc(); // all unknown blocks are defined this way
 						break;
 				}
-				tape_skip(k+l);
 				if (l)
 					--t,t+=1+sprintf(t,", %i bytes",l);
 				if (u) // keep block invisible
 					t=u;
 			}
-		if (i>=0) // tape is too long :-(
+		if (n<tape_blockcount) // tape is too long :-(
 		{
-			t+=1+sprintf(t,TAPE_CATALOG_HEAD " ...",j=tape_filetell);
+			t+=1+sprintf(t,TAPE_CATALOG_HEAD " ...",j=tape_blocks[n],TAPE_CATALOG_TIME(n));
 			if (j<=z)
 				++p;
 		}
@@ -762,6 +1176,37 @@ void tape_select(int i) // caller must provide a valid offset
 	tape_seek(i);
 	tape_count=tape_pilots=tape_syncs=tape_bits=tape_wave=tape_kansas=tape_general_totp=tape_general_totd=0,tape_hold=2*1000; // reset counter and playback // 2-second gap
 }
+void tape_select_block(int n) // jump to the beginning of block `n`, without the 2-second gap
+{
+	if (!tape||tape_type<0||n<0||n>=tape_blockcount)
+		return;
+	tape_select(tape_blocks[n]);
+	tape_hold=tape_loop=0; tape_status=tape_blocktypes[n]>>7; // restore the signal before the block
+	for (int i=n;--i>=0&&(tape_blocktypes[i]&127)!=0x25;) // restore the LOOP around the block, if any
+		if ((tape_blocktypes[i]&127)==0x24)
+		{
+			tape_seek(tape_blocks[i]+1); tape_loop=tape_fgetcc(); tape_looptell=tape_filetell;
+			tape_seek(tape_blocks[n]); break;
+		}
+}
+int tape_select_time(int t) // jump to the moment `t` (in milliseconds) of the tape; 0 OK, !0 ERROR
+{
+	if (!tape||tape_type<0||tape_blockcount<1||t<0||(t=(long long)t*tape_playback/1000)>=tape_blocktimes[tape_blockcount])
+		return 1;
+	int i=0,j=tape_blockcount,k;
+	while (j-i>1) // find the last block that begins before `t`
+		if (tape_blocktimes[k=(i+j)>>1]>t)
+			j=k;
+		else
+			i=k;
+	tape_select_block(i);
+	if ((t-=tape_blocktimes[i])<0) // the gap before the first block?
+		tape_hold=t*1000LL/tape_playback; // negative HOLDs are silent
+	else // play the block until we reach `t`
+		for (long long l=(long long)t*TICKS_PER_SECOND/tape_playback;l>0;l-=TICKS_PER_SECOND/1000) // small steps avoid overflows in tape_main()
+			tape_main(l<TICKS_PER_SECOND/1000?l:TICKS_PER_SECOND/1000);
+	return 0;
+}
 
 // tape speed-up hacks ---------------------------------------------- //
 
@@ -784,6 +1229,52 @@ int fasttape_test(const BYTE *s,WORD p) // compares a chunk of memory against a
 		}
 }
 
+// the patterns of a table are sorted in buckets by the byte they expect at the tested address itself,
+// so looking for the pattern of an address only tests the patterns in its bucket plus the ones that don't care.
+
+int fasttape_key(const BYTE *s) // returns the byte that pattern `s` expects at its own address, -1 if any
+{
+	for (int p=0,a,z;;)
+		if (*s==0x80) // relative word
+		{
+			if (p==0||p==-1)
+				return -1;
+			p+=2; s+=2;
+		}
+		else // offset+length memcmp
+		{
+			a=p+(signed char)s[0]; z=a+s[1];
+			if (a==z)
+				return -1; // end of pattern
+			if (a<=0&&z>0)
+				return s[2-a];
+			p=z; s+=2+z-a;
+		}
+}
+void fasttape_hash(BYTE (*t)[32],int n,BYTE *h) // builds the buckets `h` (257+n bytes) of the `n` patterns in `t`
+{
+	memset(h,255,257+n); // 0-255: first pattern of each byte, 256: first pattern of any byte, 257+: next pattern
+	for (int i=n,k;--i>=0;) // backwards, so the chains keep the order of the table
+	{
+		if ((k=fasttape_key(t[i]))<0)
+			k=256;
+		h[257+i]=h[k]; h[k]=i;
+	}
+}
+int fasttape_find(BYTE (*t)[32],int n,const BYTE *h,WORD p) // returns the first pattern in `t` that matches `p`, `n` if none
+{
+	for (int i=h[PEEK(p)],j=h[256],k;(k=i<j?i:j)<n;) // merge the bucket and the patterns of any byte
+	{
+		if (fasttape_test(t[k],p))
+			return k;
+		if (k==i)
+			i=h[257+i];
+		else
+			j=h[257+j];
+	}
+	return n;
+}
+
 void fasttape_skip(int q,int x) // skip the signal in steps of `x` until it changes
 {
 	q&=1; while (q==tape_status&&(tape||tape_hold)) tape_main(x);
@@ -810,7 +1301,7 @@ BYTE fasttape_feed(int q,int x) // get a whole byte from the stream, but leave t
 			tape_general_totd-=7,tape_general_count-=7;
 		else
 			tape_bits-=7,tape_mask>>=7;
-		fasttape_skip(q,x); return i;
+		++tape_stats_fed; fasttape_skip(q,x); return i;
 	}
 int FASTTAPE_CAN_DUMP(void) { return tape_general_bits?tape_general_totd>=24:tape_bits>=24; } // all but the final bytes!
 BYTE fasttape_dump(void) // get a whole byte from the stream and consume all signals
@@ -820,7 +1311,7 @@ BYTE fasttape_dump(void) // get a whole byte from the stream and consume all sig
 			tape_general_totd-=8;
 		else
 			tape_bits-=8;
-		return i; // no `fasttape_skip` here
+		++tape_stats_dumped; return i; // no `fasttape_skip` here
 	}
 
 void fasttape_gotonext(void) // skips the current block (minus the last bits) if the PILOT and SYNCS are already over
@@ -856,4 +1347,63 @@ void fasttape_gotonext(void) // skips the current block (minus the last bits) if
 	tape_loop=0; // just in case a tape uses this!
 }
 
+// tape telemetry --------------------------------------------------- //
+
+void tape_stats_frame(int q) // charge the last frame to the current block; `q` is false if the tape stood still
+{
+	long long c=clock();
+	if (q&&tape&&tape_stats_frames)
+	{
+		int i=tape_block_find(tape_filetell);
+		++tape_stats_frames[i],tape_stats_clocks[i]+=c-tape_stats_clock;
+	}
+	tape_stats_clock=c;
+}
+void tape_stats_miss(WORD p) // the tape was polled from `p` but no known loader was there
+{
+	int i=0; ++tape_stats_misses;
+	while (i<tape_stats_pcn&&tape_stats_pc[i]!=p)
+		++i;
+	if (i<tape_stats_pcn)
+		++tape_stats_pcs[i];
+	else if (i<TAPE_STATS_PCS) // the table is full? count the miss, but forget the address
+		tape_stats_pc[i]=p,tape_stats_pcs[i]=1,++tape_stats_pcn;
+}
+int tape_stats_top(void) // returns the address that polled the tape the most times, -1 if none
+{
+	int i,j=-1;
+	for (i=0;i<tape_stats_pcn;++i)
+		if (tape_stats_pcs[i]>0&&(j<0||tape_stats_pcs[i]>tape_stats_pcs[j]))
+			j=i;
+	return j;
+}
+int tape_stats_debug(char *t) // prints the counters in seven lines of twenty characters; returns the length
+{
+	int i=tape&&tape_blockcount?tape_block_find(tape_filetell):0,j=tape_stats_top();
+	i=sprintf(t,"TAPE:  BLOCK %04i:%02X",i,tape&&tape_blockcount?tape_blocktypes[i]&127:0);
+	i+=sprintf(t+i,"  TRAPS:    %08i" "  MISSES:   %08i",tape_stats_traps,tape_stats_misses);
+	i+=sprintf(t+i,"  DUMPED:   %08i" "  FED:      %08i",tape_stats_dumped,tape_stats_fed);
+	i+=sprintf(t+i,"  EDGES:    %08i",tape_stats_bytes-tape_stats_fed);
+	if (j<0)
+		i+=sprintf(t+i,"  PC ----:  --------");
+	else
+		i+=sprintf(t+i,"  PC %04X:  %08i",tape_stats_pc[j],tape_stats_pcs[j]);
+	return i;
+}
+void tape_stats_json(FILE *f) // writes the counters as a JSON object
+{
+	int i,j;
+	fprintf(f,"{\n\t\"traps\": %i,\n\t\"misses\": %i,\n\t\"dumped\": %i,\n\t\"fed\": %i,\n\t\"edges\": %i,\n\t\"pcs\": [",
+		tape_stats_traps,tape_stats_misses,tape_stats_dumped,tape_stats_fed,tape_stats_bytes-tape_stats_fed);
+	for (i=0;(j=tape_stats_top())>=0;++i) // most frequent first; the table is spent
+		fprintf(f,"%s\n\t\t{ \"pc\": %i, \"polls\": %i }",i?",":"",tape_stats_pc[j],tape_stats_pcs[j]),tape_stats_pcs[j]=0;
+	fprintf(f,"%s],\n\t\"blocks\": [",i?"\n\t":"");
+	if (tape&&tape_stats_frames)
+		for (i=0;i<tape_blockcount;++i)
+			fprintf(f,"%s\n\t\t{ \"offset\": %i, \"type\": %i, \"tape_ms\": %i, \"emulated_ms\": %i, \"host_ms\": %i }",i?",":"",
+				tape_blocks[i],tape_blocktypes[i]&127,(int)(tape_blocktimes[i]*1000LL/tape_playback),
+				tape_stats_frames[i]*1000/VIDEO_PLAYBACK,(int)(tape_stats_clocks[i]*1000/CLOCKS_PER_SEC));
+	fprintf(f,"%s]\n}\n",tape&&tape_stats_frames&&tape_blockcount?"\n\t":"");
+}
+
 // ============================================== END OF TAPE SUPPORT //
@@ -752,6 +752,29 @@ INLINE int session_listen(void) // handle all pending messages; 0 OK, !0 EXIT
 	return q;
 }
 
+// read-only file mapping: Win32 file mapping objects -------------- //
+
+BYTE *session_mapfile(FILE *f,int l) // map the first `l` bytes of file `f` onto memory; NULL if it's impossible
+{
+	HANDLE h; BYTE *t=NULL;
+	if (h=CreateFileMapping((HANDLE)_get_osfhandle(_fileno(f)),NULL,PAGE_READONLY,0,0,NULL))
+		t=MapViewOfFile(h,FILE_MAP_READ,0,0,l),CloseHandle(h); // the view keeps the mapping alive
+	return t;
+}
+#define session_unmapfile(t,l) UnmapViewOfFile(t)
+
+// background workers: Win32 threads and semaphores ---------------- //
+
+#define SESSION_THREAD HANDLE
+#define SESSION_SEMAPHORE HANDLE
+#define SESSION_WORKER(f) DWORD WINAPI f(LPVOID session_worker_arg)
+#define session_thread_create(f) CreateThread(NULL,0,(f),NULL,0,NULL) // NULL if threads aren't available
+#define session_thread_finish(t) (WaitForSingleObject((t),INFINITE),CloseHandle(t))
+#define session_semaphore_create() CreateSemaphore(NULL,0,1<<30,NULL)
+#define session_semaphore_post(s) ReleaseSemaphore((s),1,NULL)
+#define session_semaphore_wait(s) WaitForSingleObject((s),INFINITE)
+#define session_semaphore_remove(s) CloseHandle(s)
+
 void session_writewave(AUDIO_UNIT *t); // save the current sample frame. Must be defined later on!
 FILE *session_filmfile=NULL; void session_writefilm(void); // must be defined later on, too!
 INLINE void session_render(void) // update video, audio and timers
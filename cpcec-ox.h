@@ -39,6 +39,7 @@
 	#include <dirent.h> // opendir()...
 	#include <sys/stat.h> // stat()...
 	#include <unistd.h> // ftruncate(),fileno()...
+	#include <sys/mman.h> // mmap()...
 	#define fsetsize(f,l) (!ftruncate(fileno(f),(l)))
 	#define BYTE Uint8
 	#define WORD Uint16
@@ -1535,6 +1536,38 @@ INLINE int session_listen(void) // handle all pending messages; 0 OK, !0 EXIT
 	return q;
 }
 
+// read-only file mapping: Win32 file mapping objects or POSIX mmap() //
+
+BYTE *session_mapfile(FILE *f,int l) // map the first `l` bytes of file `f` onto memory; NULL if it's impossible
+{
+	#ifdef _WIN32
+	HANDLE h; BYTE *t=NULL;
+	if (h=CreateFileMapping((HANDLE)_get_osfhandle(_fileno(f)),NULL,PAGE_READONLY,0,0,NULL))
+		t=MapViewOfFile(h,FILE_MAP_READ,0,0,l),CloseHandle(h); // the view keeps the mapping alive
+	return t;
+	#else
+	void *t=mmap(NULL,l,PROT_READ,MAP_PRIVATE,fileno(f),0);
+	return t==MAP_FAILED?NULL:t;
+	#endif
+}
+#ifdef _WIN32
+#define session_unmapfile(t,l) UnmapViewOfFile(t)
+#else
+#define session_unmapfile(t,l) munmap((t),(l))
+#endif
+
+// background workers: SDL threads and semaphores ------------------ //
+
+#define SESSION_THREAD SDL_Thread*
+#define SESSION_SEMAPHORE SDL_sem*
+#define SESSION_WORKER(f) int SDLCALL f(void *session_worker_arg)
+#define session_thread_create(f) SDL_CreateThread((f),"",NULL) // NULL if threads aren't available
+#define session_thread_finish(t) SDL_WaitThread((t),NULL)
+#define session_semaphore_create() SDL_CreateSemaphore(0)
+#define session_semaphore_post(s) SDL_SemPost(s)
+#define session_semaphore_wait(s) SDL_SemWait(s)
+#define session_semaphore_remove(s) SDL_DestroySemaphore(s)
+
 void session_writewave(AUDIO_UNIT *t); // save the current sample frame. Must be defined later on!
 FILE *session_filmfile=NULL; void session_writefilm(void); // must be defined later on, too!
 INLINE void session_render(void) // update video, audio and timers
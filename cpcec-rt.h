@@ -397,9 +397,18 @@ INLINE void audio_playframe(int q,AUDIO_UNIT *ao) // call between frames by the
 
 int video_pos_z=0; // for statistics and debugging
 int session_signal_frames=0,session_signal_scanlines=0;
+BYTE session_headless=0; int session_headframes=0; // headless mode: frames go straight into the wavefile, without any window or audio device
+void session_writewave(AUDIO_UNIT *t); // defined later on
 INLINE void session_update(void) // render video+audio thru OS and handle realtime logic (self-adjusting delays, automatic frameskip, etc.)
 {
-	session_render();
+	if (session_headless)
+	{
+		if (audio_disabled) // silent frames must stay silent
+			memset(audio_frame,AUDIO_ZERO,sizeof(audio_buffer));
+		--session_headframes,session_writewave(audio_frame);
+	}
+	else
+		session_render();
 	session_signal&=~SESSION_SIGNAL_FRAME; // new frame!
 	audio_target=audio_frame;
 	if (video_scanline==3)
@@ -417,51 +426,44 @@ INLINE void session_update(void) // render video+audio thru OS and handle realti
 
 // temporary variables
 unsigned char *puff_src,*puff_tgt; // source and target buffers
-int puff_srcl,puff_tgtl,puff_srco,puff_tgto,puff_buff,puff_bits;
-struct puff_huff { short *cnt,*sym; }; // Huffman table element
+int puff_srcl,puff_tgtl,puff_srco,puff_tgto,puff_bits;
+unsigned long long puff_buff; // up to 64 bits are fetched at once
+#define PUFF_FAST 10 // codes up to this size are decoded with a single table lookup
+struct puff_huff { short *cnt,*sym,*fast; }; // Huffman table element; `fast` entries are LENGTH*512+SYMBOL, 0 if the code is longer
 // auxiliary functions
+INLINE void puff_fill(void) // fetches as many source bytes as possible into the bit buffer
+{
+	while (puff_bits<=56&&puff_srco<puff_srcl)
+		puff_buff|=(unsigned long long)puff_src[puff_srco++]<<puff_bits,puff_bits+=8;
+}
 int puff_read(int n) // reads N bits from source; <0 ERROR
 {
-	int a=puff_buff;
-	while (puff_bits<n)
-	{
-		if (puff_srco>=puff_srcl)
+	if (puff_bits<n)
+		if (puff_fill(),puff_bits<n)
 			return -1; // source overrun!
-		a+=puff_src[puff_srco++]<<puff_bits; // copy byte from source
-		puff_bits+=8; // skip byte from source
-	}
-	puff_buff=a>>n; puff_bits-=n; // adjust target and flush bits
-	return a&((1<<n)-1); // result!
+	int a=puff_buff&((1<<n)-1);
+	puff_buff>>=n; puff_bits-=n; // flush bits
+	return a; // result!
 }
 int puff_decode(struct puff_huff *h) // decodes Huffman code from source; <0 ERROR
 {
-	int l=1;
-	short *next=h->cnt;
-	int i=0,base=0,code=0;
-	int buff=puff_buff,bits=puff_bits; // local copies are faster!
-	for (;;)
+	if (puff_bits<15)
+		puff_fill();
+	int i=h->fast[puff_buff&((1<<PUFF_FAST)-1)];
+	if (i&&(i>>9)<=puff_bits) // short code?
+		return puff_buff>>=i>>9,puff_bits-=i>>9,i&511; // result!
+	int l=1,base=0,code=0;
+	unsigned long long buff=puff_buff; // local copies are faster!
+	for (i=0;l<=15&&l<=puff_bits;++l) // long codes are decoded bit by bit
 	{
-		while (bits--)
-		{
-			code+=buff&1;
-			buff>>=1;
-			int o=*++next;
-			if (code<base+o) // does the code fit the interval?
-			{
-				puff_buff=buff; // adjust target
-				puff_bits=(puff_bits-l)&7; // flush bits
-				return h->sym[i+(code-base)]; // result!
-			}
-			i+=o,base=(base+o)<<1,code<<=1,++l; // calculate next interval
-		}
-		if (!(bits=(15+1)-l))
-			return -1; // invalid value!
-		if (puff_srco>=puff_srcl)
-			return -1; // source overrun!
-		buff=puff_src[puff_srco++]; // copy byte from source
-		if (bits>8)
-			bits=8; // flush source bits
+		code+=buff&1;
+		buff>>=1;
+		int o=h->cnt[l];
+		if (code<base+o) // does the code fit the interval?
+			return puff_buff=buff,puff_bits-=l,h->sym[i+(code-base)]; // result!
+		i+=o,base=(base+o)<<1,code<<=1; // calculate next interval
 	}
+	return -1; // invalid value! source overrun!
 }
 int puff_tables(struct puff_huff *h,short *l,int n) // generates Huffman tables from canonical table; !0 ERROR
 {
@@ -469,8 +471,13 @@ int puff_tables(struct puff_huff *h,short *l,int n) // generates Huffman tables
 	short o[15+1];
 	for (i=0;i<=15;++i)
 		h->cnt[i]=0; // reset all bit counts
+	for (i=0;i<(1<<PUFF_FAST);++i)
+		h->fast[i]=0; // reset all short codes
 	for (i=0;i<n;++i)
-		++(h->cnt[l[i]]); // increase relevant bit counts
+		if (l[i]<0||l[i]>15)
+			return h->cnt[0]=-1; // invalid value!
+		else
+			++(h->cnt[l[i]]); // increase relevant bit counts
 	if (h->cnt[0]==n)
 		return 0; // already done!
 	for (a=i=1;i<=15;++i)
@@ -481,6 +488,13 @@ int puff_tables(struct puff_huff *h,short *l,int n) // generates Huffman tables
 	for (i=0;i<n;++i)
 		if (l[i])
 			h->sym[o[l[i]]++]=i; // define symbols from bit offsets
+	for (int code=0,k=0,b=1;b<=PUFF_FAST;++b,code<<=1) // canonical codes are stored backwards, as they're read bit by bit
+		for (int j=0;j<h->cnt[b];++j,++code,++k)
+		{
+			int r=0; for (i=0;i<b;++i) r|=((code>>i)&1)<<(b-1-i); // reverse the code bits
+			for (;r<(1<<PUFF_FAST);r+=1<<b)
+				h->fast[r]=(b<<9)+h->sym[k]; // all the entries that begin with this code
+		}
 	return a; // 0 if complete, >0 otherwise!
 }
 int puff_expand(struct puff_huff *puff_lcode,struct puff_huff *puff_ocode) // expands DEFLATE source into target; !0 ERROR
@@ -508,11 +522,14 @@ int puff_expand(struct puff_huff *puff_lcode,struct puff_huff *puff_ocode) // ex
 				return -1; // invalid value!
 			if (puff_tgto+(l=lcode[0][a]+puff_read(lcode[1][a]))>puff_tgtl)
 				return -1; // target overrun!
-			if ((a=puff_decode(puff_ocode))<0)
+			if ((a=puff_decode(puff_ocode))<0||a>=30)
 				return a; // invalid value!
 			if ((o=puff_tgto-ocode[0][a]-puff_read(ocode[1][a]))<0)
 				return -1; // source underrun!
-			do puff_tgt[puff_tgto++]=puff_tgt[o++]; while (--l);
+			if (o+l<=puff_tgto) // distant copies don't overlap
+				memcpy(&puff_tgt[puff_tgto],&puff_tgt[o],l),puff_tgto+=l;
+			else
+				do puff_tgt[puff_tgto++]=puff_tgt[o++]; while (--l);
 		}
 		else return 0; // end of block
 	}
@@ -520,6 +537,7 @@ int puff_expand(struct puff_huff *puff_lcode,struct puff_huff *puff_ocode) // ex
 // block type handling
 INLINE int puff_stored(void) // copies raw uncompressed byte block from source to target; !0 ERROR
 {
+	puff_srco-=puff_bits>>3; // return the unused bytes in the bit buffer
 	if (puff_srco+4>puff_srcl)
 		return -1; // source overrun!
 	puff_buff=puff_bits=0; // ignore remaining bits
@@ -531,13 +549,13 @@ INLINE int puff_stored(void) // copies raw uncompressed byte block from source t
 		return -1; // invalid value!
 	if (puff_srco+l>puff_srcl||puff_tgto+l>puff_tgtl)
 		return -1; // source/target overrun!
-	do puff_tgt[puff_tgto++]=puff_src[puff_srco++]; while (--l); // copy source to target and update pointers
+	memcpy(&puff_tgt[puff_tgto],&puff_src[puff_srco],l),puff_tgto+=l,puff_srco+=l; // copy source to target and update pointers
 	return 0;
 }
-short puff_lencnt[15+1],puff_lensym[288]; // 286 and 287 are reserved
-short puff_offcnt[15+1],puff_offsym[32]; // 30 and 31 are reserved
-struct puff_huff puff_lcode={ puff_lencnt,puff_lensym };
-struct puff_huff puff_ocode={ puff_offcnt,puff_offsym };
+short puff_lencnt[15+1],puff_lensym[288],puff_lenfast[1<<PUFF_FAST]; // 286 and 287 are reserved
+short puff_offcnt[15+1],puff_offsym[32],puff_offfast[1<<PUFF_FAST]; // 30 and 31 are reserved
+struct puff_huff puff_lcode={ puff_lencnt,puff_lensym,puff_lenfast };
+struct puff_huff puff_ocode={ puff_offcnt,puff_offsym,puff_offfast };
 INLINE int puff_static(void) // generates default Huffman codes and expands block from source to target; !0 ERROR
 {
 	short t[288+32];
@@ -567,7 +585,9 @@ INLINE int puff_dynamic(void) // generates custom Huffman codes and expands bloc
 	while (i<l+o)
 	{
 		int a;
-		if ((a=puff_decode(&puff_lcode))<16) // literal?
+		if ((a=puff_decode(&puff_lcode))<0)
+			return a; // invalid value!
+		if (a<16) // literal?
 			t[i++]=a; // copy literal
 		else
 		{
@@ -614,11 +634,48 @@ INLINE int puff_main(void) // inflates compressed source into target; !0 ERROR
 }
 
 // standard ZIP v2.0 archive reader that relies on
-// the main directory at the end of the ZIP archive
+// the main directory at the end of the ZIP archive;
+// the directory is loaded at once and hashed by name,
+// and it's kept until another archive is opened.
 
 FILE *puff_file=NULL;
 unsigned char puff_name[256],puff_type;
 unsigned int puff_skip,puff_next,puff_diff,puff_hash;//,puff_time
+unsigned char *puff_dir=NULL; int puff_dirsize,puff_dirbase,puff_dirlength,*puff_dirhash=NULL,puff_dirmask; // central directory and its index
+char puff_dirpath[STRMAX]=""; unsigned int puff_dirtail; // the archive that owns the directory, and the CRC32 of its tail
+unsigned int puff_dirname(char *s,int l) // hashes the first `l` chars of a filename, regardless of case and path style
+{
+	unsigned int h=0; while (l--&&*s)
+	{
+		int c=(BYTE)*s++; if (c==PATHCHAR) c='/'; else if (c>='A'&&c<='Z') c+=32;
+		h=h*33+c;
+	}
+	return h;
+}
+// simple ANSI X3.66, eight bytes at a time ("slicing-by-8")
+unsigned int puff_dohash(unsigned int k,unsigned char *s,int l)
+{
+	static unsigned int z[8][256]; // calculated on the first call
+	if (!z[0][1])
+	{
+		for (int i=0;i<256;++i)
+		{
+			unsigned int j=i; for (int b=0;b<8;++b) j=(j>>1)^(0xEDB88320&-(j&1));
+			z[0][i]=j;
+		}
+		for (int i=0;i<256;++i)
+			for (int b=1;b<8;++b)
+				z[b][i]=(z[b-1][i]>>8)^z[0][z[b-1][i]&255];
+	}
+	for (;l>=8;s+=8,l-=8)
+	{
+		unsigned int h=k^(s[0]+(s[1]<<8)+(s[2]<<16)+(s[3]<<24)),j=s[4]+(s[5]<<8)+(s[6]<<16)+(s[7]<<24);
+		k=z[7][h&255]^z[6][(h>>8)&255]^z[5][(h>>16)&255]^z[4][h>>24]^z[3][j&255]^z[2][(j>>8)&255]^z[1][(j>>16)&255]^z[0][j>>24];
+	}
+	while (l-->0)
+		k=(k>>8)^z[0][(k^*s++)&255];
+	return k;
+}
 void puff_close(void) // closes the current ZIP archive
 {
 	if (puff_file)
@@ -646,16 +703,44 @@ int puff_open(char *s) // opens a new ZIP archive; !0 ERROR
 	}
 	if (i<0)
 		return puff_close(),1;
-	puff_diff=l-mgetiiii(&session_scratch[i+12])-(puff_next=mgetiiii(&session_scratch[i+16]))-k+i; // actual archive header offset
-	return 0;
+	int n=mgetiiii(&session_scratch[i+12]),o=mgetiiii(&session_scratch[i+16]);
+	puff_diff=l-n-o-k+i; // actual archive header offset
+	puff_next=0; // the first header is at the beginning of the directory
+	unsigned int z=puff_dohash(0,session_scratch,k); // the tail holds the directory (or its end), so rewriting the archive changes it
+	if (puff_dir&&puff_dirsize==n&&puff_dirbase==puff_diff+o&&puff_dirlength==l&&puff_dirtail==z&&!strcmp(puff_dirpath,s))
+		return 0; // the directory is already in memory
+	if (puff_dir)
+		free(puff_dir),puff_dir=NULL;
+	if (puff_dirhash)
+		free(puff_dirhash),puff_dirhash=NULL;
+	*puff_dirpath=0;
+	if (n<0||!(puff_dir=malloc(n+1)))
+		return puff_close(),1;
+	fseek(puff_file,puff_dirbase=puff_diff+o,SEEK_SET);
+	if (fread1(puff_dir,puff_dirsize=n,puff_file)!=n)
+		return free(puff_dir),puff_dir=NULL,puff_close(),1;
+	for (i=1,o=0;o+46<=n&&!memcmp(&puff_dir[o],"PK\001\002",4);o+=46+mgetii(&puff_dir[o+28])+mgetii(&puff_dir[o+30])+mgetii(&puff_dir[o+32]))
+		i+=2; // count the files
+	for (puff_dirmask=15;puff_dirmask<i;puff_dirmask=puff_dirmask*2+1) ; // at least twice the files
+	if (puff_dirhash=malloc(sizeof(int)*(puff_dirmask+1)))
+	{
+		memset(puff_dirhash,0,sizeof(int)*(puff_dirmask+1));
+		for (o=0;o+46<=n&&!memcmp(&puff_dir[o],"PK\001\002",4);o+=46+mgetii(&puff_dir[o+28])+mgetii(&puff_dir[o+30])+mgetii(&puff_dir[o+32]))
+			if (o+46+puff_dir[o+28]<=n&&!puff_dir[o+11]&&puff_dir[o+28]&&!puff_dir[o+29]) // skip the headers that puff_head() rejects
+			{
+				unsigned int h=puff_dirname((char*)&puff_dir[o+46],puff_dir[o+28]);
+				while (puff_dirhash[h&puff_dirmask]) ++h;
+				puff_dirhash[h&puff_dirmask]=o+1; // offset+1, as 0 means empty
+			}
+	}
+	return puff_dirlength=l,puff_dirtail=z,strcpy(puff_dirpath,s),0;
 }
 int puff_head(void) // reads a ZIP file header, if any; !0 ERROR
 {
 	if (!puff_file)
 		return -1;
-	unsigned char h[46];
-	fseek(puff_file,puff_diff+puff_next,SEEK_SET);
-	if (fread(h,1,sizeof(h),puff_file)!=sizeof(h)||memcmp(h,"PK\001\002",4)||h[11]||!h[28]||h[29])//||(h[8]&8)
+	unsigned char *h=&puff_dir[puff_next];
+	if (puff_next+46>puff_dirsize||memcmp(h,"PK\001\002",4)||h[11]||!h[28]||h[29]||puff_next+46+h[28]>puff_dirsize)//||(h[8]&8)
 		return puff_close(),1; // reject EOFs, unknown IDs, extended types and improperly sized filenames!
 	puff_type=h[10];
 	puff_srcl=mgetiiii(&h[20]);
@@ -664,7 +749,7 @@ int puff_head(void) // reads a ZIP file header, if any; !0 ERROR
 	puff_hash=mgetiiii(&h[16]);
 	puff_skip=mgetiiii(&h[42]); // the body that belongs to the current head
 	puff_next+=46+h[28]+mgetii(&h[30])+mgetii(&h[32]); // next ZIP file header
-	puff_name[fread1(puff_name,h[28],puff_file)]=0;
+	memcpy(puff_name,&h[46],h[28]); puff_name[h[28]]=0;
 	#if PATHCHAR != '/' // ZIP archives use the UNIX style
 		char *s=puff_name;
 		while (*s)
@@ -675,6 +760,20 @@ int puff_head(void) // reads a ZIP file header, if any; !0 ERROR
 	#endif
 	return 0;
 }
+int puff_find(char *s) // reads the ZIP file header of the file `s`; !0 ERROR
+{
+	if (!puff_dirhash) // no index? scan the whole directory!
+	{
+		while (!puff_head())
+			if (!strcasecmp(puff_name,s))
+				return 0;
+		return 1;
+	}
+	for (unsigned int h=puff_dirname(s,STRMAX);puff_dirhash[h&puff_dirmask];++h)
+		if (puff_next=puff_dirhash[h&puff_dirmask]-1,!puff_head()&&!strcasecmp(puff_name,s))
+			return 0;
+	return 1;
+}
 int puff_body(int q) // loads (!0) or skips (0) a ZIP file body; !0 ERROR
 {
 	puff_tgto=puff_srco=0;
@@ -700,26 +799,36 @@ int puff_body(int q) // loads (!0) or skips (0) a ZIP file body; !0 ERROR
 	}
 	return q; // 0 skipped=OK, !0 unknown=ERROR
 }
-// simple ANSI X3.66
-unsigned int puff_dohash(unsigned int k,unsigned char *s,int l)
+// ZIP-aware fopen(): decompressed files are kept in a small cache, so opening them again,
+// for example when swapping the discs of a multi-disc archive, doesn't inflate them again.
+// files are identified by their full paths and their CRC32 and size as stored in the archive,
+// so archives that change while the emulator is running aren't a problem.
+#define PUFF_CACHE_ITEMS 16 // maximum amount of cached files
+int puff_cachelimit=16; // cache budget in megabytes; the least recently used files go first
+char PUFF_STR[]={PATHCHAR,PATHCHAR,PATHCHAR,0},puff_path[STRMAX]; // i.e. "TREE/PATH///ARCHIVE/FILE"
+char puff_cachepath[PUFF_CACHE_ITEMS][STRMAX]; unsigned char *puff_cachedata[PUFF_CACHE_ITEMS]; // NULL if unused
+unsigned int puff_cachehash[PUFF_CACHE_ITEMS]; int puff_cachesize[PUFF_CACHE_ITEMS],puff_cachetime[PUFF_CACHE_ITEMS],puff_cacheclock=0;
+int puff_cacheslot(int l) // make room for `l` bytes in the cache; returns the free item, <0 if the file doesn't fit
 {
-	static unsigned int z[]= {0,0x1DB71064,0x3B6E20C8,0x26D930AC,0x76DC4190,0x6B6B51F4,0x4DB26158,0x5005713C,
-		0xEDB88320,0xF00F9344,0xD6D6A3E8,0xCB61B38C,0x9B64C2B0,0x86D3D2D4,0xA00AE278,0xBDBDF21C}; // precalc'd!
-	for (int i=0;i<l;++i)
-		k^=s[i],k=(k>>4)^z[k&15],k=(k>>4)^z[k&15];
-	return k;
+	if (l>(puff_cachelimit<<20))
+		return -1; // too big!
+	for (;;)
+	{
+		int i,j=-1,k=-1,n=l;
+		for (i=0;i<PUFF_CACHE_ITEMS;++i)
+			if (!puff_cachedata[i])
+				k=i; // free item
+			else if (n+=puff_cachesize[i],j<0||puff_cachetime[i]<puff_cachetime[j])
+				j=i; // oldest item
+		if (k>=0&&n<=(puff_cachelimit<<20))
+			return k;
+		free(puff_cachedata[j]),puff_cachedata[j]=NULL; // discard the oldest item and try again
+	}
 }
-// ZIP-aware fopen()
-char PUFF_STR[]={PATHCHAR,PATHCHAR,PATHCHAR,0},puff_path[STRMAX]; // i.e. "TREE/PATH///ARCHIVE/FILE"
-FILE *puff_ffile=NULL;
 FILE *puff_fopen(char *s,char *m) // mimics fopen(), so NULL on error, *FILE otherwise
 {
 	if (!s||!m)
 		return NULL; // wrong parameters!
-	if (puff_ffile&&!strcmp(puff_path,s))
-		return fseek(puff_ffile,0,SEEK_SET),puff_ffile; // recycle last file!
-	// TODO: handle more than one puff_ffile at once so the file caching is smart
-	//if (puff_ffile) fclose(puff_ffile),puff_ffile=NULL; // it's a new file, destroy old one and start anew
 	char *z;
 	if (!(z=strrstr(s,PUFF_STR)))//||!strchr(m,'r')) // TODO: what to do with 'w' and 'a' file modes?
 		return fopen(s,m); // normal file logic
@@ -728,36 +837,45 @@ FILE *puff_fopen(char *s,char *m) // mimics fopen(), so NULL on error, *FILE oth
 	z+=strlen(PUFF_STR);
 	if (puff_open(puff_path))
 		return 0;
-	while (!puff_head()) // scan archive
-		if (!strcasecmp(puff_name,z)) // found?
+	unsigned char *t=NULL; int i,l=0;
+	if (!puff_find(z)) // found?
+	{
+		for (i=0;i<PUFF_CACHE_ITEMS;++i)
+			if (puff_cachedata[i]&&puff_cachehash[i]==puff_hash&&puff_cachesize[i]==puff_tgtl&&!strcmp(puff_cachepath[i],s))
+				break; // cached!
+		puff_src=puff_tgt=NULL;
+		if (i<PUFF_CACHE_ITEMS)
+			t=puff_cachedata[i],l=puff_cachesize[i],puff_cachetime[i]=++puff_cacheclock;
+		else if ((!puff_type||(puff_src=malloc(puff_srcl)))&&(puff_tgt=malloc(puff_tgtl))
+			&&!puff_body(1)&&!(DWORD)~(puff_hash^puff_dohash(~0,puff_tgt,puff_tgto))) // memory or data failure?
 		{
-			if (!(puff_ffile=tmpfile()))
-				return puff_close(),NULL; // file failure!
-			puff_src=puff_tgt=NULL;
-			if (!(!puff_type||(puff_src=malloc(puff_srcl)))||!(puff_tgt=malloc(puff_tgtl))
-				||puff_body(1)||(DWORD)~(puff_hash^puff_dohash(~0,puff_tgt,puff_tgto)))
-				fclose(puff_ffile),puff_ffile=NULL; // memory or data failure!
-			if (puff_ffile)
-				fwrite1(puff_tgt,puff_tgto,puff_ffile),fseek(puff_ffile,0,SEEK_SET); // fopen() expects ftell()=0!
-			if (puff_src) free(puff_src); if (puff_tgt) free(puff_tgt);
-			puff_close();
-			if (puff_ffile) // either *FILE or NULL
-				strcpy(puff_path,s); // allow recycling!
-			else
-				*puff_path=0; // don't recycle on failure!
-			return puff_ffile;
+			t=puff_tgt,l=puff_tgto;
+			if ((i=puff_cacheslot(l))>=0) // store the file in the cache, if possible
+			{
+				strcpy(puff_cachepath[i],s),puff_cachedata[i]=t,puff_cachesize[i]=l,puff_cachehash[i]=puff_hash,puff_cachetime[i]=++puff_cacheclock;
+				puff_tgt=NULL; // the cache owns the buffer now
+			}
 		}
-		else
-			puff_body(0); // not found, skip file
-	return NULL;
+	}
+	puff_close();
+	FILE *f=NULL;
+	if (t&&(f=tmpfile()))
+		fwrite1(t,l,f),fseek(f,0,SEEK_SET); // fopen() expects ftell()=0!
+	if (puff_src) free(puff_src); if (puff_tgt) free(puff_tgt);
+	puff_src=puff_tgt=NULL;
+	return f;
 }
 int puff_fclose(FILE *f)
 {
-	return (f!=puff_ffile)?fclose(f):0; // delay closing to allow recycling
+	return fclose(f);
 }
 void puff_byebye(void)
 {
-	if (puff_ffile) fclose(puff_ffile),puff_ffile=NULL; // cleanup is done by the runtime thanks to tmpfile()
+	if (puff_dir) free(puff_dir),puff_dir=NULL;
+	if (puff_dirhash) free(puff_dirhash),puff_dirhash=NULL;
+	for (int i=0;i<PUFF_CACHE_ITEMS;++i)
+		if (puff_cachedata[i])
+			free(puff_cachedata[i]),puff_cachedata[i]=NULL; // cleanup of the files is done by the runtime thanks to tmpfile()
 }
 
 // ZIP-aware user interfaces
@@ -825,6 +943,57 @@ char *puff_session_newfile(char *x,char *y,char *z) // writing within ZIP archiv
 	return session_newfile(xx,y,z);
 }
 
+// bulk scanning of folders and ZIP archives, without any dialogs --- //
+
+int session_scanzip(char *s,char *p,void (*f)(char *)) // call `f` on each file that matches the pattern `p` within the ZIP archive `s`; returns the amount of files
+{
+	char r[STRMAX],*z=NULL,*t; int i=0,l=0,n=0;
+	if (puff_open(s))
+		return 0; // not a ZIP archive!
+	while (!puff_head())
+	{
+		if (puff_name[strlen(puff_name)-1]!='/'&&multiglobbing(p,puff_name,1)&&strlen(s)+strlen(puff_name)<STRMAX-4)
+			if (t=realloc(z,l+strlen(puff_name)+1))
+				strcpy(&(z=t)[l],puff_name),l+=strlen(puff_name)+1,++n;
+		puff_body(0);
+	}
+	puff_close(); // `f` will open the archive on its own, so the names must be gathered first
+	for (t=z;i<n;++i,t+=strlen(t)+1)
+		sprintf(r,"%s%s%s",s,PUFF_STR,t),f(r);
+	return free(z),n;
+}
+int session_scanpath(char *s,char *p,void (*f)(char *)) // call `f` on each file that matches the pattern `p` in the path `s`, its subdirectories and its ZIP archives; returns the amount of files
+{
+	char r[STRMAX]; int i,n=0;
+	if ((i=getftype(s))<0)
+		return 0; // missing path!
+	if (!i) // file?
+		return globbing(puff_pattern,s,1)?session_scanzip(s,p,f):multiglobbing(p,s,1)?f(s),1:0;
+	if ((i=strlen(strcpy(r,s)))&&r[i-1]!=PATHCHAR)
+		r[i++]=PATHCHAR;
+	#ifdef _WIN32
+	WIN32_FIND_DATA wfd; HANDLE h; strcpy(&r[i],"*");
+	if ((h=FindFirstFile(r,&wfd))!=INVALID_HANDLE_VALUE)
+	{
+		do
+			if (wfd.cFileName[0]!='.'&&i+strlen(wfd.cFileName)<STRMAX) // reject ".*"
+				strcpy(&r[i],wfd.cFileName),n+=session_scanpath(r,p,f);
+		while (FindNextFile(h,&wfd));
+		FindClose(h);
+	}
+	#else
+	DIR *d; struct dirent *e; r[i]=0;
+	if (d=opendir(r))
+	{
+		while (e=readdir(d))
+			if (e->d_name[0]!='.'&&i+strlen(e->d_name)<STRMAX) // reject ".*"
+				strcpy(&r[i],e->d_name),n+=session_scanpath(r,p,f);
+		closedir(d);
+	}
+	#endif
+	return n;
+}
+
 // on-screen and debug text printing -------------------------------- //
 
 VIDEO_UNIT onscreen_ink0,onscreen_ink1; BYTE onscreen_flag=1;
@@ -1036,32 +1205,103 @@ unsigned int session_savenext(char *z,unsigned int i) // scans for available fil
 }
 
 unsigned char waveheader[44]="RIFF\000\000\000\000WAVEfmt \020\000\000\000\001\000\000\000\000\000\000\000\000\000\000\000\000\000\000\000data";
-unsigned int session_nextwave=1,session_wavesize;
+unsigned int session_nextwave=1,session_wavesize; BYTE session_waveraw=0; // raw PCM instead of RIFF WAV?
+// frames are stored in a ring buffer that a background worker flushes in big batches,
+// so a slow disk cannot stall the emulation; without a worker we write each frame at once.
+#define SESSION_WAVERING (1<<22) // 4 MB ring buffer, a power of two!
+#define SESSION_WAVEBATCH (1<<20) // 1 MB per batch
+BYTE *session_wavering=NULL; volatile BYTE session_waveexit;
+unsigned int session_wavehead; volatile unsigned int session_wavetail,session_wavepost,session_wavelost; // free-running counters, and bytes that the worker failed to write
+SESSION_THREAD session_wavethread=NULL; SESSION_SEMAPHORE session_wavefull; SESSION_SEMAPHORE session_waveroom;
+SESSION_WORKER(session_waveworker) // flush the ring buffer until the file is closed
+{
+	unsigned int e,i,j;
+	do
+	{
+		session_semaphore_wait(session_wavefull);
+		e=session_waveexit; // must be read before `session_wavepost`!
+		while ((i=session_wavepost)!=(j=session_wavetail))
+		{
+			if ((i%=SESSION_WAVERING)<=(j%=SESSION_WAVERING))
+				i=SESSION_WAVERING; // wrap around: flush the tail of the ring first
+			session_wavelost+=i-j-fwrite1(&session_wavering[j],i-j,session_wavefile);
+			session_wavetail+=i-j;
+			session_semaphore_post(session_waveroom);
+		}
+	}
+	while (!e);
+	return 0;
+}
 int session_createwave(void) // create a wave file; !0 ERROR
 {
 	if (session_wavefile||!session_audio)
 		return 1; // file already open, or no audio to save!
-	if (!(session_nextwave=session_savenext("%s%08i.wav",session_nextwave)))
+	if (!(session_nextwave=session_savenext(session_waveraw?"%s%08i.pcm":"%s%08i.wav",session_nextwave)))
 		return 1; // too many files!
 	if (!(session_wavefile=fopen(session_parmtr,"wb")))
 		return 1; // cannot create file!
-	waveheader[0x16]=AUDIO_CHANNELS; // channels
-	mputiiii(&waveheader[0x18],AUDIO_PLAYBACK); // samples per second
-	mputiiii(&waveheader[0x1C],AUDIO_PLAYBACK*AUDIO_BITDEPTH/8*AUDIO_CHANNELS); // bytes per second
-	waveheader[0x20]=AUDIO_BITDEPTH/8*AUDIO_CHANNELS; // bytes per sample
-	waveheader[0x22]=AUDIO_BITDEPTH;
-	fwrite(waveheader,1,sizeof(waveheader),session_wavefile);
+	if (!session_waveraw)
+	{
+		waveheader[0x16]=AUDIO_CHANNELS; // channels
+		mputiiii(&waveheader[0x18],AUDIO_PLAYBACK); // samples per second
+		mputiiii(&waveheader[0x1C],AUDIO_PLAYBACK*AUDIO_BITDEPTH/8*AUDIO_CHANNELS); // bytes per second
+		waveheader[0x20]=AUDIO_BITDEPTH/8*AUDIO_CHANNELS; // bytes per sample
+		waveheader[0x22]=AUDIO_BITDEPTH;
+		fwrite(waveheader,1,sizeof(waveheader),session_wavefile);
+	}
+	session_wavehead=session_wavetail=session_wavepost=session_wavelost=session_waveexit=0;
+	if (session_wavering||(session_wavering=malloc(SESSION_WAVERING)))
+	{
+		session_wavefull=session_semaphore_create(),session_waveroom=session_semaphore_create();
+		if (!session_wavefull||!session_waveroom||!(session_wavethread=session_thread_create(session_waveworker))) // no worker? write each frame at once
+		{
+			if (session_wavefull)
+				session_semaphore_remove(session_wavefull);
+			if (session_waveroom)
+				session_semaphore_remove(session_waveroom);
+		}
+	}
 	return session_wavesize=0;
 }
-void session_writewave(AUDIO_UNIT *t) { session_wavesize+=fwrite(t,1,sizeof(audio_buffer),session_wavefile); }
+void session_writewave(AUDIO_UNIT *t) // save the current sample frame
+{
+	if (!session_wavethread)
+		{ session_wavesize+=fwrite(t,1,sizeof(audio_buffer),session_wavefile); return; }
+	BYTE *s=(BYTE*)t; unsigned int i,l=sizeof(audio_buffer);
+	while (l)
+	{
+		while (!(i=SESSION_WAVERING-(session_wavehead-session_wavetail))) // is the ring full?
+			session_wavepost=session_wavehead,session_semaphore_post(session_wavefull),session_semaphore_wait(session_waveroom);
+		if (i>SESSION_WAVERING-session_wavehead%SESSION_WAVERING)
+			i=SESSION_WAVERING-session_wavehead%SESSION_WAVERING; // don't go past the end
+		if (i>l)
+			i=l;
+		memcpy(&session_wavering[session_wavehead%SESSION_WAVERING],s,i);
+		s+=i,l-=i,session_wavehead+=i;
+	}
+	session_wavesize+=sizeof(audio_buffer);
+	if (session_wavehead-session_wavepost>=SESSION_WAVEBATCH) // wake the worker up
+		session_wavepost=session_wavehead,session_semaphore_post(session_wavefull);
+}
 int session_closewave(void) // close a wave file; !0 ERROR
 {
 	if (session_wavefile)
 	{
-		fseek(session_wavefile,0x28,SEEK_SET);
-		fputiiii(session_wavesize,session_wavefile);
-		fseek(session_wavefile,0x04,SEEK_SET);
-		fputiiii(session_wavesize+36,session_wavefile); // file=head+data
+		if (session_wavethread) // flush the remainder and wait for the worker to quit
+		{
+			session_wavepost=session_wavehead; session_waveexit=1;
+			session_semaphore_post(session_wavefull);
+			session_thread_finish(session_wavethread); session_wavethread=NULL;
+			session_semaphore_remove(session_wavefull),session_semaphore_remove(session_waveroom);
+			session_wavesize-=session_wavelost; // only count what reached the file, like the direct writes do
+		}
+		if (!session_waveraw)
+		{
+			fseek(session_wavefile,0x28,SEEK_SET);
+			fputiiii(session_wavesize,session_wavefile);
+			fseek(session_wavefile,0x04,SEEK_SET);
+			fputiiii(session_wavesize+36,session_wavefile); // file=head+data
+		}
 		fclose(session_wavefile);
 		session_wavefile=NULL;
 		return 0;
@@ -1310,17 +1550,71 @@ char *session_configread(char *t) // reads configuration file; s points to the p
 		if (!strcasecmp(session_parmtr,"safevideo")) return session_softblit=*s&1,NULL;
 		if (!strcasecmp(session_parmtr,"film")) return session_filmscale=*s&1,session_filmtimer=(*s&2)>>1,NULL;
 		if (!strcasecmp(session_parmtr,"info")) return onscreen_flag=*s&1,NULL;
+		if (!strcasecmp(session_parmtr,"rawaudio")) return session_waveraw=*s&1,NULL;
+		if (!strcasecmp(session_parmtr,"zipcache")) return puff_cachelimit=strtol(s,NULL,10)&255,NULL;
 	}
 	return s;
 }
 void session_configwrite(FILE *f) // save common parameters
 {
 	fprintf(f,
-		"film %i\ninfo %i\n"
+		"film %i\ninfo %i\nrawaudio %i\nzipcache %i\n"
 		"polyphony %i\nscanlines %i\nsoftaudio %i\nsoftvideo %i\nzoomvideo %i\nsafevideo %i\n"
-		,session_filmscale+(session_filmtimer<<1),onscreen_flag
+		,session_filmscale+(session_filmtimer<<1),onscreen_flag,session_waveraw,puff_cachelimit
 		,audio_mixmode,(video_scanline&3)+(video_scanblend?4:0),audio_filter,video_filter,session_intzoom,session_softblit
 		);
 }
 
+// the settings database is a text file with one line per known disc or tape: the CRC32 of the image in
+// hexadecimal, then the settings it needs as pairs of names and values, like in the configuration file
+// ("1234ABCD crtc 0 bank 0"). The lines must be sorted, so the file can be mapped and searched by halves.
+
+char *session_dbfile(void) // returns path to the settings database
+{
+	return strcat(strcpy(session_substr,session_path),my_caption ".db");
+}
+int session_dbfind(char *t,unsigned int k) // copy onto `t` the settings of the image whose CRC32 is `k`; 0 OK, !0 ERROR
+{
+	FILE *f; BYTE *s; unsigned int h; int i,j,l,m,n,c,z,q=1;
+	if (!(f=fopen(session_dbfile(),"rb")))
+		return 1; // no database!
+	fseek(f,0,SEEK_END);
+	if ((l=ftell(f))>0)
+	{
+		if (!(z=!!(s=session_mapfile(f,l))))
+			if (s=malloc(l)) // cannot map it, load it
+				fseek(f,0,SEEK_SET),l=fread1(s,l,f);
+		if (s)
+		{
+			for (i=0,j=l;i<j;) // `i` and `j` always point to the beginning of a line
+			{
+				for (m=(i+j)>>1;m>i&&s[m-1]!='\n';--m) ; // go back to the beginning of the line
+				for (h=0,n=m;n<l&&(c=s[n]|32,(c>='0'&&c<='9')||(c>='a'&&c<='f'));++n)
+					h=h*16+(c>'9'?c-'a'+10:c-'0');
+				if (h==k)
+				{
+					while (n<l&&(s[n]==' '||s[n]=='\t'))
+						++n;
+					for (m=0;n<l&&m<STRMAX-1&&s[n]>=' ';)
+						t[m++]=s[n++];
+					t[m]=0; q=0; break;
+				}
+				if (h>k)
+					j=m;
+				else
+				{
+					while (n<l&&s[n]!='\n')
+						++n;
+					i=n+1;
+				}
+			}
+			if (z)
+				session_unmapfile(s,l);
+			else
+				free(s);
+		}
+	}
+	return fclose(f),q;
+}
+
 // =================================== END OF OS-INDEPENDENT ROUTINES //
@@ -39,6 +39,7 @@ Contact information: <mailto:cngsoft@gmail.com> */
 #include <stdio.h> // printf()...
 #include <stdlib.h> // strtol()...
 #include <string.h> // strcpy()...
+#include <time.h> // clock()...
 
 // Amstrad CPC metrics and constants defined as general types ------- //
 
@@ -561,8 +562,12 @@ const int mmu_ram_mode[8][4]= // relative offsets of every bank for each +128K R
 	{ 0x00000-0x0000,0x18000-0x4000,0x08000-0x8000,0x0C000-0xC000 }, // RAM6: 0 6 2 3
 	{ 0x00000-0x0000,0x1C000-0x4000,0x08000-0x8000,0x0C000-0xC000 }, // RAM7: 0 7 2 3
 };
+BYTE z80_tape_stamp=0; // the tape trap cache only stays valid while the memory map doesn't change
+WORD z80_tape_index[1<<16]; // full Z80 16-bit cache: pattern in the low byte (255 when unused), `z80_tape_stamp` in the high byte
 void mmu_update(void) // update the MMU tables with all the new offsets
 {
+	if (!++z80_tape_stamp) // the code at any address may be a different one now
+		MEMFULL(z80_tape_index); // the stamp wrapped: old entries would look valid again
 	// classic CPC RAM/ROM paging
 	int i=gate_ram&(gate_ram_depth?(4<<gate_ram_depth)-1:0);
 	int j=i?128+64*(i/8):64;
@@ -736,6 +741,30 @@ int playcity_disabled=0,playcity_dirty,playcity_ctc_state[4]={0,0,0,0},playcity_
 
 #include "cpcec-ay.h"
 
+#ifdef PSG_PLAYCITY
+int playcity_mixed=-1; // current layout of the mix matrix: -1 disabled, 0 mono, 1 stereo
+void playcity_mixer(void) // set the mix matrix of the AY and PlayCity chips
+{
+	playcity_mixed=playcity_disabled?-1:playcity_dirty>1;
+	#if AUDIO_CHANNELS > 1
+	for (int c=0;c<3;++c)
+		psg_stereo[c][0]=256+psg_stereos[audio_mixmode][c],psg_stereo[c][1]=256-psg_stereos[audio_mixmode][c];
+	if (playcity_mixed>=0)
+	{
+		for (int c=0;c<3;++c)
+			for (int k=0;k<2;++k)
+				if (playcity_mixed) // PlayCity chip 0 is RIGHT, chip 1 is LEFT
+					playcity_stereo[0][c][k]=psg_stereo[2][k],playcity_stereo[1][c][k]=psg_stereo[0][k];
+				else // "ALCON 2020: SLAP FIGHT" uses just one PlayCity chip: we make it MONO and keep the STEREO of the AY chip
+					playcity_stereo[0][c][k]=psg_stereo[2][k],playcity_stereo[1][c][k]=psg_stereo[0][k]+psg_stereo[2][k];
+		if (playcity_mixed) // AY chip is CENTER
+			for (int k=0;k<2;++k)
+				psg_stereo[0][k]=psg_stereo[2][k]=psg_stereo[1][k];
+	}
+	#endif
+}
+#endif
+
 // behind the PIO: TAPE --------------------------------------------- //
 
 int tape_delay=0; // tape motor delay
@@ -1583,7 +1612,6 @@ void z80_send(WORD p,BYTE b) // the Z80 sends a byte to a hardware port
 // * tape_fastload controls the logical method (detecting tape loaders and feeding them data straight from the tape)
 
 int tape_skipload=1,tape_fastload=1,tape_skipping=0;
-BYTE z80_tape_index[1<<16]; // full Z80 16-bit cache, 255 when unused
 
 BYTE z80_tape_fastload[][32] = { // codes that read pulses : <offset, length, data> x N) -------------------------------------------------------------- MAXIMUM WIDTH //
 	/*  0 */ {  -8,   5,0X79,0XC6,0X02,0X4F,0X38,  +1,   7,0XED,0X78,0XAD,0XE6,0X80,0X20,0XF3 }, // AMSTRAD CPC FIRMWARE
@@ -1663,43 +1691,50 @@ BYTE z80_tape_fastdump[][32] = { // codes that fill blocks
 	/* 12 */ {  -5,   1,0X06,  +4,  11,0XD0,0XDD,0X75,0X00,0XDD,0X23,0X1B,0X7A,0XB3,0X20,0XF0 }, // RAINBOW ARTS
 };
 
+BYTE z80_tape_fastload_hash[257+length(z80_tape_fastload)],z80_tape_fastfeed_hash[257+length(z80_tape_fastfeed)],z80_tape_fastdump_hash[257+length(z80_tape_fastdump)];
 WORD z80_tape_spystack(WORD d) { d+=z80_sp.w; WORD i=PEEK(d); ++d; return i+256*PEEK(d); } // must keep everything 16-bit!
 int z80_tape_testfeed(WORD p)
 {
-	int i; if ((i=z80_tape_index[p])>length(z80_tape_fastfeed))
+	int i=z80_tape_index[p];
+	if (i>>8!=z80_tape_stamp||(i&=255)>length(z80_tape_fastfeed)||(i<length(z80_tape_fastfeed)&&!fasttape_test(z80_tape_fastfeed[i],p)))
 	{
-		for (i=0;i<length(z80_tape_fastfeed)&&!fasttape_test(z80_tape_fastfeed[i],p);++i) ;
-		z80_tape_index[p]=i; logprintf("FASTFEED: %04X=%02i\n",p,(i<length(z80_tape_fastfeed))?i:-1);
+		z80_tape_index[p]=z80_tape_stamp*256+(i=fasttape_find(z80_tape_fastfeed,length(z80_tape_fastfeed),z80_tape_fastfeed_hash,p)); logprintf("FASTFEED: %04X=%02i\n",p,(i<length(z80_tape_fastfeed))?i:-1);
 	}
 	return i;
 }
 int z80_tape_testdump(WORD p)
 {
-	int i; if ((i=z80_tape_index[p-1])>length(z80_tape_fastdump)) // the offset avoid conflicts with TABLE2
+	int i=z80_tape_index[p-1];
+	if (i>>8!=z80_tape_stamp||(i&=255)>length(z80_tape_fastdump)||(i<length(z80_tape_fastdump)&&!fasttape_test(z80_tape_fastdump[i],p))) // the offset avoid conflicts with TABLE2
 	{
-		for (i=0;i<length(z80_tape_fastdump)&&!fasttape_test(z80_tape_fastdump[i],p);++i) ;
-		z80_tape_index[p-1]=i; logprintf("FASTDUMP: %04X=%02i\n",p,(i<length(z80_tape_fastdump))?i:-1);
+		z80_tape_index[p-1]=z80_tape_stamp*256+(i=fasttape_find(z80_tape_fastdump,length(z80_tape_fastdump),z80_tape_fastdump_hash,p)); logprintf("FASTDUMP: %04X=%02i\n",p,(i<length(z80_tape_fastdump))?i:-1);
 	}
 	return i;
 }
+#define Z80_TAPE_FASTLOAD_CCITT (mem_rom[0x58]!=0xE9?0xB1EB:0xB8D3) // CCITT 16-bit checksum location
 void z80_tape_fastload_ccitt(int mask8) // the AMSTRAD CPC firmware keeps its own checksum
 {
-	WORD x=mem_rom[0x58]!=0xE9?0xB1EB:0xB8D3,crc16=mgetii(&PEEK(x)); // CCITT 16-bit checksum location
+	WORD x=Z80_TAPE_FASTLOAD_CCITT,crc16=mgetii(&PEEK(x));
 	do
 		crc16=(mask8^crc16)&0x8000?(crc16<<1)^4129:crc16<<1;
 	while ((mask8<<=1)&255); // notice that `mask8` uses the bottom 8 bits as a limiter
 	mputii(&POKE(x),crc16);
 }
+WORD z80_tape_fastload_ccitt8(WORD crc16,int k) // add a whole byte `k` to the checksum `crc16` at once
+{
+	k^=crc16>>8; k^=k>>4;
+	return (crc16<<8)^(k<<12)^(k<<5)^k;
+}
 
 void z80_tape_trap(void)
 {
 	int i,j,k;
-	if ((i=z80_tape_index[z80_pc.w])>length(z80_tape_fastload))
+	if ((i=z80_tape_index[z80_pc.w])>>8!=z80_tape_stamp||(i&=255)>length(z80_tape_fastload)||(i<length(z80_tape_fastload)&&!fasttape_test(z80_tape_fastload[i],z80_pc.w))) // outdated, unknown or overwritten?
 	{
-		for (i=0;i<length(z80_tape_fastload)&&!fasttape_test(z80_tape_fastload[i],z80_pc.w);++i) ;
-		z80_tape_index[z80_pc.w]=i; logprintf("FASTLOAD: %04X=%02i\n",z80_pc.w,(i<length(z80_tape_fastload))?i:-1);
+		z80_tape_index[z80_pc.w]=z80_tape_stamp*256+(i=fasttape_find(z80_tape_fastload,length(z80_tape_fastload),z80_tape_fastload_hash,z80_pc.w)); logprintf("FASTLOAD: %04X=%02i\n",z80_pc.w,(i<length(z80_tape_fastload))?i:-1);
 	}
-	if (i>=length(z80_tape_fastload)) return; // only known methods can reach here!
+	if (i>=length(z80_tape_fastload)) { tape_stats_miss(z80_pc.w); return; } // only known methods can reach here!
+	++tape_stats_traps;
 	if (!tape_skipping) tape_skipping=-1;
 	switch (i)
 	{
@@ -1707,11 +1742,15 @@ void z80_tape_trap(void)
 			if (z80_de.b.l==0x08&&FASTTAPE_CAN_FEED()&&(((j=z80_tape_testfeed(z80_tape_spystack(0)))==0&&!(gate_mcr&4))||j==15))
 			{
 				if (z80_tape_testdump(z80_tape_spystack(4))==0)
+				{
+					WORD x=Z80_TAPE_FASTLOAD_CCITT,crc16=mgetii(&PEEK(x));
 					while (FASTTAPE_CAN_DUMP()&&POKE(z80_sp.w+2)>1)
 					{
 						k=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--POKE(z80_sp.w+2),--POKE(z80_sp.w+3);
-						if (j==0) z80_tape_fastload_ccitt((k<<8)+1); // handle all 8 bits in a single step
+						crc16=z80_tape_fastload_ccitt8(crc16,k);
 					}
+					if (j==0) mputii(&POKE(x),crc16); // handle all the bytes in a single step
+				}
 				k=fasttape_feed(!(z80_hl.b.l>>7),16),z80_de.b.h=k>>1,tape_skipping=z80_de.b.l=1,z80_bc.b.l=-(k&1);
 				if (j==0) z80_tape_fastload_ccitt((k<<8)+2); // handle 7 bits, leave the last one to the firmware!
 			}
@@ -1724,7 +1763,7 @@ void z80_tape_trap(void)
 			if (z80_hl.b.l==0x01&&FASTTAPE_CAN_FEED()&&z80_tape_testfeed(z80_tape_spystack(0))==1)
 			{
 				if (z80_af2.b.l&0x40) if (z80_tape_testdump(z80_tape_spystack(0))==1)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						z80_hl.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de.w;
 				k=fasttape_feed(z80_bc.b.l>>7,25),tape_skipping=z80_hl.b.l=128+(k>>1),z80_bc.b.h=-(k&1);
 			}
@@ -1735,7 +1774,7 @@ void z80_tape_trap(void)
 			if (z80_hl2.b.l==0x01&&FASTTAPE_CAN_FEED()&&((j=z80_tape_testfeed(z80_tape_spystack(0)))==1||j==2||j==5))
 			{
 				if (z80_af2.b.l&0x40) if ((k=z80_tape_testdump(z80_tape_spystack(0)))==2||k==3||k==5)
-					while (FASTTAPE_CAN_DUMP()&&z80_de2.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de2.w>1)
 						z80_hl2.b.h^=POKE(z80_ix.w)=fasttape_dump(),k==3?--z80_ix.w:++z80_ix.w,--z80_de2.w;
 				k=fasttape_feed(z80_bc2.b.l>>6,16),tape_skipping=z80_hl2.b.l=128+(k>>1),z80_bc2.b.h=-(k&1);
 			}
@@ -1769,7 +1808,7 @@ void z80_tape_trap(void)
 			if (PEEK(z80_sp.w+3)==0x08&&FASTTAPE_CAN_FEED()&&z80_tape_testfeed(z80_tape_spystack(0))==6)
 			{
 				if ((k=z80_tape_testdump(z80_tape_spystack(0)))==6||k==7)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						z80_hl2.w+=POKE(z80_ix.w)=fasttape_dump(),--z80_ix.w,--z80_de.w; // k==6 doesn't touch Z80_HL2
 				k=fasttape_feed(0,13),POKE(z80_sp.w+3)=1,z80_hl.b.h=tape_skipping=(k>>1),z80_hl.b.l=k&1?-2:0; // -2 avoids the later INC L!
 			}
@@ -1783,7 +1822,7 @@ void z80_tape_trap(void)
 			if (PEEK(z80_sp.w+3)==0x08&&FASTTAPE_CAN_FEED()&&z80_tape_testfeed(z80_tape_spystack(0))==6)
 			{
 				if (z80_tape_testdump(z80_tape_spystack(0))==7)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						z80_hl2.w+=POKE(z80_ix.w)=fasttape_dump(),--z80_ix.w,--z80_de.w;
 				k=fasttape_feed(0,8),POKE(z80_sp.w+3)=1,z80_hl.b.h=tape_skipping=(k>>1),z80_hl.b.l=-(k&1);
 			}
@@ -1797,7 +1836,7 @@ void z80_tape_trap(void)
 			if (z80_hl.b.l==0x01&&FASTTAPE_CAN_FEED()&&((j=z80_tape_testfeed(z80_tape_spystack(0)))==7||j==8||j==9||j==12))
 			{
 				if ((k=z80_tape_testdump(z80_tape_spystack(0)))==8||k==9)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						z80_af2.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de.w; // some Ricochet versions ("OCTOPLEX") don't touch Z80_AF2
 				k=fasttape_feed(z80_bc.b.l>>7,15);
 				if (j==7) // SPEEDLOCK V1 uses the stack
@@ -1852,7 +1891,7 @@ void z80_tape_trap(void)
 			if (z80_hl2.b.l==0x01&&FASTTAPE_CAN_FEED()&&z80_tape_testfeed(z80_tape_spystack(0))==5)
 			{
 				if (z80_af2.b.l&0x40) if (z80_tape_testdump(z80_tape_spystack(0))==5)
-					while (FASTTAPE_CAN_DUMP()&&z80_de2.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de2.w>1)
 						z80_hl2.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de2.w;
 				k=fasttape_feed(z80_bc2.b.l>>7,18),tape_skipping=z80_hl2.b.l=128+(k>>1),z80_bc2.b.h=-(k&1);
 			}
@@ -1863,7 +1902,7 @@ void z80_tape_trap(void)
 			if (z80_hl2.b.l==0x01&&FASTTAPE_CAN_FEED()&&z80_tape_testfeed(z80_tape_spystack(0))==5)
 			{
 				if (z80_tape_testdump(z80_tape_spystack(0))==10)
-					while (FASTTAPE_CAN_DUMP()&&z80_de2.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de2.w>1)
 						z80_hl2.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de2.w;
 				k=fasttape_feed(z80_bc2.b.l>>7,17),tape_skipping=z80_hl2.b.l=128+(k>>1),z80_bc2.b.h=-(k&1);
 			}
@@ -1880,7 +1919,7 @@ void z80_tape_trap(void)
 			if (z80_hl.b.l==0x01&&FASTTAPE_CAN_FEED()&&z80_tape_testfeed(z80_tape_spystack(0))==5)
 			{
 				if (z80_af2.b.l&0x40) if (z80_tape_testdump(z80_tape_spystack(0))==5)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						z80_hl.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de.w;
 				k=fasttape_feed(z80_bc.b.l>>6,18),tape_skipping=z80_hl.b.l=128+(k>>1),z80_bc.b.h=-(k&1);
 			}
@@ -1891,7 +1930,7 @@ void z80_tape_trap(void)
 			if (z80_hl.b.l==0x01&&FASTTAPE_CAN_FEED()&&z80_tape_testfeed(z80_tape_spystack(0))==17)
 			{
 				if (z80_tape_testdump(z80_tape_spystack(0))==11)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de.w;
 				k=fasttape_feed(z80_bc.b.l>>7,13),tape_skipping=z80_hl.b.l=128+(k>>1),z80_hl.b.h=-(k&1);
 			}
@@ -1913,7 +1952,7 @@ void z80_tape_trap(void)
 			if (z80_hl2.b.l==0x01&&FASTTAPE_CAN_FEED()&&z80_tape_testfeed(z80_tape_spystack(0))==5)
 			{
 				if (z80_tape_testdump(z80_tape_spystack(2))==12)
-					while (FASTTAPE_CAN_DUMP()&&z80_de2.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de2.w>1)
 						POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de2.w;
 				k=fasttape_feed(z80_bc2.b.l>>7,17),tape_skipping=z80_hl2.b.l=128+(k>>1),z80_bc2.b.h=-(k&1);
 			}
@@ -1947,6 +1986,21 @@ void z80_tape_trap(void)
 	}
 }
 
+// the disc equivalent of tape_fastload: when the Z80 is caught inside the AMSDOS loop that fetches
+// the bytes of READ DATA and READ TRACK one by one, we transfer them all at once; the Z80 only has to
+// store the last byte and see the FDC enter the result phase, as if it had done all the work itself.
+
+int disc_fastload=0; // instant-disc mode, disabled by default
+const BYTE z80_disc_fastread[]={ -3,   9,0X0C,0XED,0X78,0X77,0X0D,0X23,0XED,0X78,0XF2,0X80,0XFB,  +0,   4,0XE6,0X20,0X20,0XF1,  +0,   0 }; // AMSDOS: INC C: IN A,(C): LD (HL),A: DEC C: INC HL: IN A,(C): JP P,$-2: AND 32: JR NZ,$-13
+BYTE z80_disc_trap(void) // the Z80 reads a byte from the FDC during the execution phase
+{
+	BYTE b=disc_data_recv();
+	if (disc_phase==3&&fasttape_test(z80_disc_fastread,z80_pc.w))
+		while (disc_phase==3&&!disc_delay&&!mmu_bit[z80_hl.w>>14]) // stop if the FDC isn't ready or the target memory is special
+			POKE(z80_hl.w)=b,++z80_hl.w,b=disc_data_recv();
+	return b;
+}
+
 BYTE z80_recv(WORD p) // the Z80 receives a byte from a hardware port
 {
 	// as in z80_send, multiple devices can answer to the Z80 request at the same time if the bit patterns match; hence the use of "b&=" from the second device onward.
@@ -2013,7 +2067,7 @@ BYTE z80_recv(WORD p) // the Z80 receives a byte from a hardware port
 	if (!(p&0x0400)) // 0xFB00, FDC 765
 		if (!disc_disabled)
 			if ((p&0x0380)==0x0300) // 0xFB7F: DATA I/O // 0xFB7E: STATUS
-					b&=p&1?disc_data_recv():disc_data_info(); // 0xF87E+n
+					b&=p&1?(disc_fastload&&disc_phase==3?z80_disc_trap():disc_data_recv()):disc_data_info(); // 0xF87E+n
 	if (p==0xFEFE)
 		b=0xCE; // emulator ID styled after the old CPCE
 	return b;
@@ -2220,7 +2274,8 @@ void z80_debug_hard(int q,int x,int y)
 				,plus_sprite_xyz[i*16+12]&15
 				);
 		}
-		else q=0; // fallback
+		else // tape telemetry
+			t=s+tape_stats_debug(s);
 	}
 	if (!(q&1))
 	{
@@ -2584,6 +2639,9 @@ void all_reset(void) // reset everything!
 	z80_imd=1; // implicit in "Pro Tennis Tour" PLUS!
 	crtc_table[0]=63; crtc_table[3]=0x8E; crtc_table[4]=38; crtc_table[9]=7; crtc_syncs_update(); // implicit in "GNG11B" (?)
 	MEMFULL(z80_tape_index);
+	fasttape_hash(z80_tape_fastload,length(z80_tape_fastload),z80_tape_fastload_hash);
+	fasttape_hash(z80_tape_fastfeed,length(z80_tape_fastfeed),z80_tape_fastfeed_hash);
+	fasttape_hash(z80_tape_fastdump,length(z80_tape_fastdump),z80_tape_fastdump_hash);
 	#ifdef PSG_PLAYCITY
 	playcity_reset(); playcity_dirty=0;
 	MEMZERO(playcity_ctc_count);
@@ -3114,10 +3172,107 @@ int any_load_catalog(int t,int r) // load track `t` and sectors from `r` to `r+3
 	disc_parmtr[5]=2;
 	for (t=0;r<s;++r)
 		if (disc_parmtr[4]=r,!disc_sector_find(l)) // load sectors if available
-			disc_sector_seek(l,disc_sector_last),t+=fread1(&disc_buffer[t],0x200,disc[0]);
+			disc_sector_seek(l,disc_sector_last),t+=disc_image_read(0,disc_sector_offset,&disc_buffer[t],0x200);
 	return t;
 }
 
+int any_load_autorun(char *t,char *u) // store in `t` the command that launches the disc in A:; `u`, if not NULL, receives the names of its files as a list of strings. Returns the amount of files
+{
+	int i,j,k,n=0; // disc autorun is more complex than tape because we must find out the right file
+	if ((j=any_load_catalog(0,0xC1))!=0x800) // VENDOR format instead of DATA?
+		if ((j=any_load_catalog(2,0x41))!=0x800) // VENDOR format instead of DATA?
+			j=any_load_catalog(1,0x01); // IBM format instead of VENDOR or DATA?
+	BYTE bestfile[STRMAX]; bestfile[8]='.'; // filenames follow the "8.3" style
+	int bestscore=bestfile[0]=0;
+	logprintf("AUTORUN: ");
+	if (j==0x800) // we got a seemingly valid catalogue
+		for (i=0;i<0x800;i+=32) // scan the catalogue
+			// check whether the entry is valid at all: it belongs to USER 0, it's got a valid entry length, WORD is ZERO and SIZE is NONZERO and VALID
+			if (!disc_buffer[i]&&!disc_buffer[i+12]&&!disc_buffer[i+14]&&disc_buffer[i+15]>0&&disc_buffer[i+15]<=128&&disc_buffer[i+16])
+			{
+				int h=disc_buffer[i+10]&128,c; // HIDDEN flag!
+				for (k=1,j=1;j<12;++j)
+					k&=(c=(disc_buffer[i+j]&=127))>=32&&c!=34; // remove bit 7 (used to tag the file as READ ONLY, HIDDEN, etc) and accept all printable characters but quotes
+				if (k&&disc_buffer[i+1]>32) // all chars are valid; measure how good it is as a candidate
+				{
+					if (++n,u)
+						u+=1+sprintf(u,"%.8s.%s",&disc_buffer[i+1],&disc_buffer[i+9]); // the entry is zero-terminated
+					k=33-disc_buffer[i+15]/4; // the shortest files are often the most likely to be loaders, and BASIC the most likely, while BINARY goes next
+					if (!h)
+						k+=48; // visible files are better candidates
+					if (!memcmp(&disc_buffer[i+1],"DISC    ",8)||!memcmp(&disc_buffer[i+1],"DISK    ",8))
+						k+=128; // RUN"DISC and RUN"DISK are standard!!
+					else if (disc_buffer[i+1]=='-')
+						k+=40; // very popular shortcut in French prods!
+					if (!memcmp(&disc_buffer[i+9],"   ",3))
+						k+=32; // together with BAS, a typical launch file
+					else if (!memcmp(&disc_buffer[i+9],"BAS",3))
+						k+=30; // ditto
+					else if (!memcmp(&disc_buffer[i+9],"BIN",3))
+						k+=28; // still standard, but the worst case
+					logprintf("`%s`:%i ",&disc_buffer[i+1],k);
+					if (bestscore<k)
+					{
+						bestscore=k;
+						MEMNCPY(bestfile,&disc_buffer[i+1],8); // name
+						strcpy(&bestfile[9],&disc_buffer[i+9]); // extension
+					}
+				}
+			}
+	if (bestscore) // load and run a file
+		sprintf(t,"RUN\"%s",bestfile);
+	else // no known files, run boot sector
+		strcpy(t,"|CPM");
+	logprintf("%s\n",t);
+	if (u)
+		*u=0; // end of list
+	return n;
+}
+
+unsigned int disc_hash(int drive) // returns the CRC32 of the tracks of disc `drive`, without the disc header and the track headers
+{
+	unsigned int k=~0; int i,j,n=disc_index_table[drive][0x30]*disc_index_table[drive][0x31];
+	for (i=0;i<n;++i)
+		if ((j=(i+1<n?disc_track_index[drive][i+1]:disc_imagesize[drive])-disc_track_index[drive][i]-256)>0&&disc_track_index[drive][i]+256+j<=disc_imagesize[drive])
+			k=puff_dohash(k,&disc_image[drive][disc_track_index[drive][i]+256],j);
+	return ~k;
+}
+int any_load_user[4],any_load_used[4],any_load_mask=0; // the user's settings that a known title replaced, the values it used instead, and which ones
+#define ANY_LOAD_SET(n,v,x) ((any_load_mask&(1<<n))||(any_load_user[n]=v),any_load_mask|=1<<n,any_load_used[n]=v=x)
+void any_load_undo(void) // give the user's settings back, unless the user changed them since
+{
+	if (any_load_mask&1&&type_id==any_load_used[0]) type_id=any_load_user[0];
+	if (any_load_mask&2&&crtc_type==any_load_used[1]) crtc_type=any_load_user[1];
+	if (any_load_mask&4&&gate_ram_depth==any_load_used[2]) gate_ram_depth=any_load_user[2];
+	if (any_load_mask&8&&tape_fastload==any_load_used[3]) tape_fastload=any_load_user[3];
+	any_load_mask=0;
+}
+void any_load_setup(unsigned int k) // apply the settings of the disc or tape whose CRC32 is `k`, if the database knows it; they use the same names as the configuration file, plus "fast" (tape analysis)
+{
+	char s[STRMAX],*t,*u; int i; logprintf("SETTINGS: %08X",k);
+	any_load_undo(); // the settings of the previous title don't apply anymore
+	if (!session_dbfind(s,k))
+		for (t=strtok(s," \t");t&&(u=strtok(NULL," \t"));t=strtok(NULL," \t"))
+		{
+			logprintf(" %s=%s",t,u);
+			if (!strcasecmp(t,"type")) { if ((i=*u&15)<length(bios_system)) ANY_LOAD_SET(0,type_id,i); }
+			else if (!strcasecmp(t,"crtc")) { if ((i=*u&15)<5) ANY_LOAD_SET(1,crtc_type,i); }
+			else if (!strcasecmp(t,"bank")) { if ((i=*u&15)<5) ANY_LOAD_SET(2,gate_ram_depth,i); }
+			else if (!strcasecmp(t,"fast")) ANY_LOAD_SET(3,tape_fastload,*u&1);
+		}
+	logprintf("\n");
+}
+
+void any_disc_close(int drive) // close the disc before another one replaces it, warning if its changes were lost
+{
+	if (disc_close(drive))
+		session_message("Cannot save disc!",txt_error);
+}
+void any_tape_close(void) // close the tape before another one replaces it, warning if the recording failed
+{
+	if (tape_close())
+		session_message("Cannot record tape!",txt_error);
+}
 int any_load(char *s,int q) // load a file regardless of format. `s` path, `q` autorun; 0 OK, !0 ERROR
 {
 	autorun_t=autorun_mode=0; // cancel any autoloading yet
@@ -3125,64 +3280,21 @@ int any_load(char *s,int q) // load a file regardless of format. `s` path, `q` a
 	{
 		if (bios_load(s))
 		{
-			if (tape_open(s))
+			if (any_tape_close(),tape_open(s))
 			{
-				if (disc_open(s,0,0))
+				if (any_disc_close(0),disc_open(s,0,0))
 					return 1; // everything failed!
 				if (q)
 				{
-					// disc autorun is more complex than tape because we must find out the right file
-					int i,j,k;
-					if ((j=any_load_catalog(0,0xC1))!=0x800) // VENDOR format instead of DATA?
-						if ((j=any_load_catalog(2,0x41))!=0x800) // VENDOR format instead of DATA?
-							j=any_load_catalog(1,0x01); // IBM format instead of VENDOR or DATA?
-					BYTE bestfile[STRMAX]; bestfile[8]='.'; // filenames follow the "8.3" style
-					int bestscore=bestfile[0]=0;
-					logprintf("AUTORUN: ");
-					if (j==0x800) // we got a seemingly valid catalogue
-						for (i=0;i<0x800;i+=32) // scan the catalogue
-							// check whether the entry is valid at all: it belongs to USER 0, it's got a valid entry length, WORD is ZERO and SIZE is NONZERO and VALID
-							if (!disc_buffer[i]&&!disc_buffer[i+12]&&!disc_buffer[i+14]&&disc_buffer[i+15]>0&&disc_buffer[i+15]<=128&&disc_buffer[i+16])
-							{
-								int h=disc_buffer[i+10]&128,c; // HIDDEN flag!
-								for (k=1,j=1;j<12;++j)
-									k&=(c=(disc_buffer[i+j]&=127))>=32&&c!=34; // remove bit 7 (used to tag the file as READ ONLY, HIDDEN, etc) and accept all printable characters but quotes
-								if (k&&disc_buffer[i+1]>32) // all chars are valid; measure how good it is as a candidate
-								{
-									k=33-disc_buffer[i+15]/4; // the shortest files are often the most likely to be loaders, and BASIC the most likely, while BINARY goes next
-									if (!h)
-										k+=48; // visible files are better candidates
-									if (!memcmp(&disc_buffer[i+1],"DISC    ",8)||!memcmp(&disc_buffer[i+1],"DISK    ",8))
-										k+=128; // RUN"DISC and RUN"DISK are standard!!
-									else if (disc_buffer[i+1]=='-')
-										k+=40; // very popular shortcut in French prods!
-									if (!memcmp(&disc_buffer[i+9],"   ",3))
-										k+=32; // together with BAS, a typical launch file
-									else if (!memcmp(&disc_buffer[i+9],"BAS",3))
-										k+=30; // ditto
-									else if (!memcmp(&disc_buffer[i+9],"BIN",3))
-										k+=28; // still standard, but the worst case
-									logprintf("`%s`:%i ",&disc_buffer[i+1],k);
-									if (bestscore<k)
-									{
-										bestscore=k;
-										MEMNCPY(bestfile,&disc_buffer[i+1],8); // name
-										strcpy(&bestfile[9],&disc_buffer[i+9]); // extension
-									}
-								}
-							}
-					if (bestscore) // load and run a file
-						sprintf(autorun_line,"RUN\"%s",bestfile);
-					else // no known files, run boot sector
-						strcpy(autorun_line,"|CPM");
-					logprintf("%s\n",autorun_line);
+					any_load_autorun(autorun_line,NULL);
 					disc_disabled=0,tape_close(); // open disc? enable disc, close tapes!
 				}
 			}
 			else if (q)
-				disc_disabled|=2,disc_close(0),disc_close(1); // open tape? close discs!
+				disc_disabled|=2,any_disc_close(0),any_disc_close(1); // open tape? close discs!
 			if (q) // autorun for tape and disc
 			{
+				any_load_setup(disc_disabled?tape_hash():disc_hash(0)); // known settings, if any
 				dandanator_remove(),biostype_id=biostype_id>2?-1:biostype_id,all_reset(),bios_reload(); // set PLUS BIOS if required
 				autorun_mode=disc_disabled?1:2,autorun_t=(type_id<3?0:-50); // -50 to handle the PLUS menu
 			}
@@ -3195,6 +3307,35 @@ int any_load(char *s,int q) // load a file regardless of format. `s` path, `q` a
 	return 0;
 }
 
+// bulk catalogue of discs and tapes -------------------------------- //
+
+// the index file describes each disc or tape with a line that holds its path, its type, its format and
+// the command that launches it, separated by tabs; the following lines begin with a tab and list either
+// the files in the disc catalogue or the blocks in the tape, so other tools don't need to open the images.
+
+char index_pattern[]="*.dsk;*.cdt;*.csw;*.wav";
+FILE *index_file=NULL; // the index being written, if any
+void index_any(char *s) // describe the disc or tape `s` in the index file
+{
+	char *t=session_scratch; int i;
+	if (!disc_open(s,0,0))
+	{
+		any_load_autorun(session_tmpstr,t);
+		fprintf(index_file,"%s\tDISC\t%s %i:%i\t%s\n",s,disc_index_table[0][0]=='M'?"MV - CPC":"EXTENDED",disc_index_table[0][0x30],disc_index_table[0][0x31],session_tmpstr);
+		disc_close(0);
+	}
+	else if (!tape_open(s))
+	{
+		tape_catalog(t,length(session_scratch));
+		fprintf(index_file,"%s\tTAPE\t%s\tRUN\"\n",s,multiglobbing("*.wav",s,1)?"WAV":tape_type<2?"CSW":tape_type<3?"CDT":"TAP");
+		tape_close();
+	}
+	else
+		return; // neither a disc nor a tape!
+	for (;*t;t+=i+1)
+		i=strlen(t),fprintf(index_file,"\t%s\n",t);
+}
+
 // auxiliary user interface operations ------------------------------ //
 
 BYTE key2joy_flag=0;
@@ -3215,10 +3356,12 @@ char session_menudata[]=
 	"0x8701 Create disc in A:..\n"
 	"0x0700 Remove disc from A:\tCtrl+F7\n"
 	"0x0701 Flip disc sides in A:\n"
+	"0x0702 Save disc changes in A:\n"
 	"0xC700 Insert disc into B:..\tShift+F7\n"
 	"0xC701 Create disc in B:..\n"
 	"0x4700 Remove disc from B:\tCtrl+Shift+F7\n"
 	"0x4701 Flip disc sides in B:\n"
+	"0x4702 Save disc changes in B:\n"
 	"=\n"
 	"0x8800 Insert tape..\tF8\n"
 	"0xC800 Record tape..\tShift+F8\n"
@@ -3245,6 +3388,7 @@ char session_menudata[]=
 	"0x4900 Tape analysis\tCtrl+Shift+F9\n"
 	//"0x4901 Tape analysis+cheating\n"
 	"0x0901 Tape auto-rewind\n"
+	"0x0902 Disc speed-up\n"
 	"0x0400 Virtual joystick\tCtrl+F4\n"
 	"0x0401 Flip joystick buttons\n"
 	"Settings\n"
@@ -3327,6 +3471,7 @@ char session_menudata[]=
 	"=\n"
 	"0x0C00 Record WAV file\tCtrl+F12\n"
 	"0x4C00 Record YM file\tCtrl+Shift+F12\n"
+	"0x0C01 Record AY stems\n"
 	"Help\n"
 	"0x8100 Help..\tF1\n"
 	"0x0100 About..\tCtrl+F1\n"
@@ -3344,6 +3489,7 @@ void session_menuinfo(void)
 	session_menucheck(0xCC00,(size_t)session_filmfile);
 	session_menucheck(0x0C00,(size_t)session_wavefile);
 	session_menucheck(0x4C00,(size_t)psg_logfile);
+	session_menucheck(0x0C01,(size_t)psg_stemfile);
 	session_menucheck(0x8700,(size_t)disc[0]);
 	session_menucheck(0xC700,(size_t)disc[1]);
 	session_menucheck(0x0701,disc_flip[0]);
@@ -3352,6 +3498,7 @@ void session_menuinfo(void)
 	session_menucheck(0xC800,tape_type<0&&tape);
 	session_menucheck(0x0900,tape_skipload);
 	session_menucheck(0x0901,tape_rewind);
+	session_menucheck(0x0902,disc_fastload);
 	session_menucheck(0x4900,tape_fastload);
 	//session_menucheck(0x4901,tape_fastfeed);
 	session_menucheck(0x0400,session_key2joy);
@@ -3384,17 +3531,14 @@ void session_menuinfo(void)
 	kbd_joy[5]=kbd_joy[7]=0x4D-key2joy_flag;
 	#if AUDIO_CHANNELS > 1
 	session_menuradio(0xC401+audio_mixmode,0xC401,0xC404);
+	#ifndef PSG_PLAYCITY
 	for (int i=0;i<3;++i)
 		psg_stereo[i][0]=256+psg_stereos[audio_mixmode][i],psg_stereo[i][1]=256-psg_stereos[audio_mixmode][i];
-	#ifdef PSG_PLAYCITY
-	if (!playcity_disabled)
-	{
-		playcity_stereo[0][0]=psg_stereo[2][0]; playcity_stereo[0][1]=psg_stereo[2][1]; // PlayCity chip 0 is RIGHT
-		playcity_stereo[1][0]=psg_stereo[0][0]; playcity_stereo[1][1]=psg_stereo[0][1]; // PlayCity chip 1 is LEFT
-		psg_stereo[0][0]=psg_stereo[2][0]=psg_stereo[1][0]; psg_stereo[0][1]=psg_stereo[2][1]=psg_stereo[1][1]; // AY chip is CENTER
-	}
 	#endif
 	#endif
+	#ifdef PSG_PLAYCITY
+	playcity_mixer(); // the mix matrix includes the AY chip
+	#endif
 	video_resetscanline(); // video scanline cfg
 	z80_multi=1+z80_turbo; // setup overclocking
 	sprintf(session_info,"%i:%iK %s%c %0.1fMHz"//" | disc %s | tape %s | %s"
@@ -3627,7 +3771,7 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 			if (!disc_disabled)
 				if (s=puff_session_newfile(disc_path,"*.dsk",session_shift?"Create disc in B:":"Create disc in A:"))
 				{
-					if (disc_create(s))
+					if (any_disc_close(session_shift),disc_create(s))
 						session_message("Cannot create disc!",txt_error);
 					else
 						disc_open(s,session_shift,1);
@@ -3636,24 +3780,28 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 		case 0x8700: // F7: INSERT DISC..
 			if (!disc_disabled)
 				if (s=puff_session_getfilereadonly(disc_path,"*.dsk",session_shift?"Insert disc into B:":"Insert disc into A:",disc_filemode&1))
-					if (disc_open(s,session_shift,!session_filedialog_get_readonly()))
+					if (any_disc_close(session_shift),disc_open(s,session_shift,!session_filedialog_get_readonly()&&!strrstr(s,PUFF_STR))) // discs inside ZIP archives cannot be saved
 						session_message("Cannot open disc!",txt_error);
 			break;
 		case 0x0700: // ^F7: EJECT DISC
-			disc_close(session_shift);
+			any_disc_close(session_shift);
 			break;
 		case 0x0701:
 			disc_flip[session_shift]^=1;
 			break;
+		case 0x0702: // SAVE DISC CHANGES
+			if (disc_image_flush(session_shift))
+				session_message("Cannot save disc!",txt_error);
+			break;
 		case 0x8800: // F8: INSERT OR RECORD TAPE..
 			if (session_shift)
 			{
-				if (s=puff_session_newfile(tape_path,"*.csw","Record tape"))
-					if (tape_create(s))
+				if (s=puff_session_newfile(tape_path,"*.csw;*.cdt","Record tape"))
+					if (any_tape_close(),tape_create(s))
 						session_message("Cannot create tape!",txt_error);
 			}
 			else if (s=puff_session_getfile(tape_path,"*.cdt;*.csw;*.wav","Insert tape"))
-				if (tape_open(s))
+				if (any_tape_close(),tape_open(s))
 					session_message("Cannot open tape!",txt_error);
 			break;
 		case 0x8801: // BROWSE TAPE
@@ -3664,12 +3812,12 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 				{
 					sprintf(session_parmtr,"Browse tape %s",tape_path);
 					if (session_list(i,session_scratch,session_parmtr)>=0)
-						tape_select(strtol(session_parmtr,NULL,10));
+						tape_select_block(tape_block_find(strtol(session_parmtr,NULL,10))); // each item begins with the offset of its block
 				}
 			}
 			break;
 		case 0x0800: // ^F8: REMOVE TAPE
-			tape_close();
+			any_tape_close();
 			break;
 		case 0x8900: // F9: DEBUG
 			if (!session_shift)
@@ -3700,6 +3848,9 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 			//if (session_shift) tape_fastfeed=!tape_fastfeed; else
 				tape_rewind=!tape_rewind;
 			break;
+		case 0x0902:
+			disc_fastload=!disc_fastload;
+			break;
 		case 0x8A00: // FULL SCREEN
 			session_togglefullscreen();
 			break;
@@ -3760,6 +3911,11 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 			else if (session_closewave()) // toggles recording
 				session_createwave();
 			break;
+		case 0x0C01: // RECORD AY STEMS
+			if (psg_closestem()) // toggles recording
+				if (psg_nextstem=session_savenext("%s%08i.stems.wav",psg_nextstem))
+					psg_createstem(session_parmtr);
+			break;
 		case 0x8F00: // ^PAUSE
 		case 0x0F00: // PAUSE
 			if (!(session_signal&SESSION_SIGNAL_DEBUG))
@@ -3843,7 +3999,7 @@ void printferror(char *s) { sprintf(session_tmpstr,"Error: %s\n",s); session_mes
 
 int mainloop(void)
 {
-	if (!session_listen())
+	if (session_headless?session_headframes>0:!session_listen())
 	{
 		while (!session_signal)
 			z80_main(
@@ -3855,6 +4011,9 @@ int mainloop(void)
 			);
 		if (session_signal&SESSION_SIGNAL_FRAME) // end of frame?
 		{
+			tape_stats_frame(tape_enabled); // tape telemetry
+			if (video_framelimit>MAIN_FRAMESKIP_MASK&&video_framecount>=MAIN_FRAMESKIP_MASK) // loading turbo?
+				video_framecount=0; // show the last frame we drew, the status and the progress bar
 			if (!video_framecount&&onscreen_flag)
 			{
 				if (disc_disabled)
@@ -3879,6 +4038,8 @@ int mainloop(void)
 				}
 				else
 					onscreen_text(+7, -3, tape_type < 0 ? "REC" : "---", q);
+				if (video_framelimit>MAIN_FRAMESKIP_MASK&&tape_filesize) // loading turbo? show the progress bar
+					i=(long long)tape_filetell*16/(tape_filesize+1),onscreen_bool(+11,-3,i,1,1),onscreen_bool(+11+i,-3,16-i,1,0);
 				if (session_stick|session_key2joy)
 				{
 					onscreen_bool(-4,-8,1,2,kbd_bit_tst(kbd_joy[0]));
@@ -3908,28 +4069,14 @@ int mainloop(void)
 			#ifdef PSG_PLAYCITY
 				if (!playcity_disabled)
 				{
-					// "ALCON 2020: SLAP FIGHT" uses just one Playcity chip: we make it MONO and restore the STEREO to the original AY chip
-					if (playcity_dirty<2)
-					{
-						playcity_stereo[1][0]+=playcity_stereo[0][0]; playcity_stereo[1][1]+=playcity_stereo[0][1];
-					}
+					if (playcity_mixed!=(playcity_dirty>1))
+						playcity_mixer(); // the chips in use have changed
 					playcity_main(audio_frame,AUDIO_LENGTH_Z);
-					if (playcity_dirty<2)
-					{
-						playcity_stereo[1][0]-=playcity_stereo[0][0]; playcity_stereo[1][1]-=playcity_stereo[0][1];
-						psg_stereo[0][0]=playcity_stereo[1][0]; psg_stereo[0][1]=playcity_stereo[1][1];
-						psg_stereo[2][0]=playcity_stereo[0][0]; psg_stereo[2][1]=playcity_stereo[0][1];
-					}
-					else
-					{
-						psg_stereo[0][0]=psg_stereo[2][0]=psg_stereo[1][0];
-						psg_stereo[0][1]=psg_stereo[2][1]=psg_stereo[1][1];
-					}
 				}
 			#endif
 			}
 			audio_queue=0; // wipe audio queue and force a reset
-			psg_writelog();
+			psg_writelog(); psg_writestem();
 			crtc_giga=crtc_giga_count>=156&&crtc_giga_count<312&&crtc_table[7]; crtc_giga_count=0; // autodetect Gigascreen effects
 			if (tape_enabled)
 				{ if (tape_delay>0) --tape_delay; } // handle tape delays
@@ -3939,7 +4086,7 @@ int mainloop(void)
 				tape_closed=0,session_dirtymenu=1; // tag tape as closed
 			tape_skipping=audio_pos_z=0;
 			if (tape&&tape_skipload&&!tape_delay) // &&tape_enabled
-				session_fast|=2,video_framelimit|=(MAIN_FRAMESKIP_MASK+1),video_interlaced|=2,audio_disabled|=2; // abuse binary logic to reduce activity
+				session_fast|=2,video_framelimit|=(MAIN_FRAMESKIP_MASK+1),video_interlaced|=2,audio_disabled|=2; // abuse binary logic to reduce activity: the loading turbo doesn't draw any frames
 			else
 				session_fast&=~2,video_framelimit&=~(MAIN_FRAMESKIP_MASK+1),video_interlaced&=~2,audio_disabled&=~2; // ditto, to restore normal activity
 			session_update();
@@ -3953,7 +4100,7 @@ int mainloop(void)
 
 int main(int argc,char *argv[])
 {
-	int i,j; FILE *f;
+	int i,j,k=-1; FILE *f,*stats_file=NULL; // `k` is the starting position of the tape, in seconds; `stats_file` gets the tape telemetry
 	session_detectpath(argv[0]);
 	if (f=fopen(session_configfile(),"r"))
 	{
@@ -3973,6 +4120,14 @@ int main(int argc,char *argv[])
 			{
 				switch (argv[i][j++])
 				{
+					case 'a':
+						for (session_headframes=0;argv[i][j]>='0'&&argv[i][j]<='9';++j)
+							session_headframes=session_headframes*10+argv[i][j]-'0';
+						if ((session_headframes*=VIDEO_PLAYBACK)<=0)
+							i=argc; // help!
+						else
+							session_headless=1;
+						break;
 					case 'c':
 						video_scanline=(BYTE)(argv[i][j++]-'0');
 						if (video_scanline<0||video_scanline>7)
@@ -3993,6 +4148,10 @@ int main(int argc,char *argv[])
 						if (crtc_type<0||crtc_type>4)
 							i=argc; // help!
 						break;
+					case 'i':
+						if (!index_file&&!(index_file=fopen(strcat(strcpy(session_parmtr,session_path),my_caption ".idx"),"w")))
+							i=argc; // help!
+						break;
 					case 'j':
 						session_key2joy=1;
 						break;
@@ -4029,6 +4188,10 @@ int main(int argc,char *argv[])
 					case 'S':
 						session_audio=0;
 						break;
+					case 't':
+						for (k=0;argv[i][j]>='0'&&argv[i][j]<='9';++j)
+							k=k*10+argv[i][j]-'0';
+						break;
 					case 'T':
 						audio_mixmode=0;
 						break;
@@ -4038,6 +4201,10 @@ int main(int argc,char *argv[])
 					case 'X':
 						disc_disabled=1;
 						break;
+					case 'y':
+						if (!stats_file&&!(stats_file=fopen(strcat(strcpy(session_parmtr,session_path),my_caption ".json"),"w")))
+							i=argc; // help!
+						break;
 					case 'Y':
 						tape_fastload=0;
 						break;
@@ -4059,6 +4226,8 @@ int main(int argc,char *argv[])
 			}
 			while ((i<argc)&&(argv[i][j]));
 		}
+		else if (index_file)
+			session_scanpath(argv[i],index_pattern,index_any);
 		else
 			if (any_load(argv[i],1))
 				i=argc; // help!
@@ -4067,10 +4236,12 @@ int main(int argc,char *argv[])
 		return
 			printfusage("usage: " MY_CAPTION
 			" [option..] [file..]\n"
+			"\t-aN\trender N seconds of audio without window\n"
 			"\t-cN\tscanline type (0..7)\n"
 			"\t-CN\tcolour palette (0..4)\n"
 			"\t-d\tdebug\n"
 			"\t-gN\tset CRTC type (0..4)\n"
+			"\t-i\tindex the files and folders into " my_caption ".idx\n"
 			"\t-j\tenable joystick keys\n"
 			"\t-J\tdisable joystick\n"
 			"\t-k0\t64k RAM\n"
@@ -4087,23 +4258,38 @@ int main(int argc,char *argv[])
 			"\t-O\tdisable onscreen status\n"
 			"\t-R\tdisable realtime\n"
 			"\t-S\tdisable sound\n"
+			"\t-tN\tstart the tape at second N\n"
 			"\t-T\tdisable stereo\n"
 			"\t-W\tfullscreen mode\n"
 			"\t-X\tdisable disc drives\n"
+			"\t-y\tsave tape statistics into " my_caption ".json\n"
 			"\t-Y\tdisable tape analysis\n"
 			"\t-Z\tdisable tape speed-up\n"
 			"\t-!\tforce software render\n"
 			),1;
+	if (index_file) // the index doesn't need the emulation
+		return fclose(index_file),puff_byebye(),0;
+	if (k>=0&&tape_select_time(k*1000))
+		return printferror("Cannot seek tape!"),1;
 	if (bios_reload()||bdos_path_load("cpcados.rom"))
 		return printferror(txt_error_bios),1;
-	char *s; if (s=session_create(session_menudata))
+	char *s; if (session_headless) // just the emulation and the wavefile, as fast as possible
+	{
+		if (!(video_frame=malloc(sizeof(VIDEO_UNIT)*VIDEO_LENGTH_X*VIDEO_LENGTH_Y)))
+			return printferror("Cannot allocate memory!"),1;
+		audio_frame=audio_buffer; session_fast=1; onscreen_flag=0; video_framelimit=MAIN_FRAMESKIP_MASK;
+		if (session_createwave())
+			return printferror("Cannot create wavefile!"),1;
+		session_menuinfo(); // no window, no menu: but the audio mixer must be set all the same
+	}
+	else if (s=session_create(session_menudata))
 		return sprintf(session_scratch,"Cannot create session: %s!",s),printferror(session_scratch),1;
 	session_kbdreset();
 	session_kbdsetup(kbd_map_xlt,length(kbd_map_xlt)/2);
 	video_target=&video_frame[video_pos_y*VIDEO_LENGTH_X+video_pos_y]; audio_target=audio_frame;
 	audio_disabled=!session_audio;
 	video_clut_update(); onscreen_inks(VIDEO1(0xAA0000),VIDEO1(0x55FF55));
-	if (session_fullscreen) session_togglefullscreen();
+	if (session_fullscreen&&!session_headless) session_togglefullscreen();
 	// it begins, "alea jacta est!"
 	#ifdef EMSCRIPTEN
 		// Setup periodic call of our main loop. Frame rate is controlled by the web browser.
@@ -4115,14 +4301,19 @@ int main(int argc,char *argv[])
 	#endif
 	// it's over, "acta est fabula"
 	z80_close(); if (mem_xtr) free(mem_xtr);
-	tape_close();
-	disc_close(0); disc_close(1);
-	psg_closelog();
+	if (stats_file)
+		tape_stats_json(stats_file),fclose(stats_file);
+	if (tape_close())
+		printferror("Cannot record tape!");
+	if (disc_close(0)|disc_close(1))
+		printferror("Cannot save disc!");
+	psg_closelog(); psg_closestem();
 	session_closefilm();
 	session_closewave();
-	if (f=fopen(session_configfile(),"w"))
+	any_load_undo(); // the configuration keeps the settings of the user, not those of the last title
+	if (!session_headless&&(f=fopen(session_configfile(),"w"))) // headless runs override several settings; don't keep them
 		session_configwritemore(f),session_configwrite(f),fclose(f);
-	return puff_byebye(),session_byebye(),0;
+	return puff_byebye(),session_headless?free(video_frame):session_byebye(),0;
 }
 
 BOOTSTRAP
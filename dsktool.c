@@ -0,0 +1,219 @@
+ //  ####  ######    ####  #######   ####    ----------------------- //
+//  ##  ##  ##  ##  ##  ##  ##   #  ##  ##  CPCEC, plain text Amstrad //
+// ##       ##  ## ##       ## #   ##       CPC emulator written in C //
+// ##       #####  ##       ####   ##       as a postgraduate project //
+// ##       ##     ##       ## #   ##       by Cesar Nicolas-Gonzalez //
+//  ##  ##  ##      ##  ##  ##   #  ##  ##  since 2018-12-01 till now //
+ //  ####  ####      ####  #######   ####    ----------------------- //
+
+#define MY_CAPTION "DSKTOOL"
+#define MY_VERSION "20210524"//"1155"
+#define MY_LICENSE "Copyright (C) 2019-2021 Cesar Nicolas-Gonzalez"
+
+
+/* This notice applies to the source code of CPCEC and its binaries.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+Contact information: <mailto:cngsoft@gmail.com> */
+
+
+// DSKTOOL is a small tool that checks the DSK disc images used by CPCEC
+// and ZXSEC and rewrites them as compact EXTENDED discs: "MV - CPC" discs
+// become "EXTENDED" ones, the unused bytes at the end of each track and
+// after the last track are removed, and unformatted tracks take no room.
+// It relies on the same disc support (CPCEC-D7.H) the emulators use, so
+// the new images behave exactly like the old ones inside the emulators.
+
+#include <stdio.h> // printf...
+#include <string.h> // strcmp...
+#include <stdlib.h> // malloc...
+
+#ifdef _WIN32 // "BYTE", "WORD" and "DWORD" are always exactly 8, 16 and 32 bits long
+
+#define WIN32_LEAN_AND_MEAN 1
+#include <windows.h>
+
+#else // "char", "short int" and "long long int" are 8, 16 and 64 bits, but "long int" can be 32 or 64 bits
+
+#include <stdint.h>
+#define BYTE uint8_t
+#define WORD uint16_t
+#define DWORD uint32_t
+
+#endif
+
+// the disc support expects a few definitions from the emulators ---- //
+
+#define STRMAX 288 // widespread in Windows
+#define INLINE
+#define length(x) (sizeof(x)/sizeof(*(x)))
+#define logprintf(...) 0
+#define MEMZERO(x) memset((x),0,sizeof(x))
+#define MEMLOAD(x,y) memcpy((x),(y),sizeof(x))
+#define mgetii(x) ((x)[0]+((x)[1]<<8))
+#define equalsii(x,i) (mgetii(x)==(i))
+#define puff_fopen fopen // no ZIP archives here
+#define puff_fclose fclose
+
+int fread1(void *t,int l,FILE *f) { int k=0,i; while (l&&(i=fread(t,1,l,f))) { t=(void*)((char*)t+i); k+=i; l-=i; } return k; } // safe fread(t,1,l,f)
+int fwrite1(void *t,int l,FILE *f) { int k=0,i; while (l&&(i=fwrite(t,1,l,f))) { t=(void*)((char*)t+i); k+=i; l-=i; } return k; } // safe fwrite(t,1,l,f)
+
+#define DISC_PARMTR_UNIT (disc_parmtr[1]&1) // only the drive A: is used
+#define DISC_PARMTR_UNITHEAD (disc_parmtr[1]&5)
+#define DISC_TIMER_INIT ( 4<<6)
+#define DISC_TIMER_BYTE ( 2<<6)
+#define DISC_WIRED_MODE 0
+#define DISC_PER_FRAME (312<<6)
+#define TICKS_PER_FRAME DISC_PER_FRAME // the disc clock never runs here
+#define DISC_CURRENT_PC 0
+
+#define DISC_NEW_SIDES 1
+#define DISC_NEW_TRACKS 40
+#define DISC_NEW_SECTORS 9
+BYTE DISC_NEW_SECTOR_IDS[]={0xC1,0xC6,0xC2,0xC7,0xC3,0xC8,0xC4,0xC9,0xC5};
+#define DISC_NEW_SECTOR_SIZE_FDC 2
+#define DISC_NEW_SECTOR_GAPS 82
+#define DISC_NEW_SECTOR_FILL 0xE5
+
+#include "cpcec-d7.h"
+
+// check a disc and build its compact image ------------------------- //
+
+BYTE *dsk_image=NULL; int dsk_length; // the new image
+int dsk_verbose=0; // list every track?
+
+int dsk_track_size(int j) // size in bytes of track+side `j` of the disc in A:
+{
+	return disc_index_table[0][0]=='M'?disc_index_table[0][0x32]+disc_index_table[0][0x33]*256:disc_index_table[0][j+0x34]*256;
+}
+
+int dsk_repack(char *s) // check the disc in `s` and build its compact image; 0 OK, !0 ERROR
+{
+	if (disc_open(s,0,0))
+		return fprintf(stderr,"%s: error: not a valid disc!\n",s),1;
+	int n=disc_index_table[0][0x31],m=disc_index_table[0][0x30]*n,q=0,z=256;
+	if (m>256-0x34) // the "EXTENDED" header cannot describe so many tracks
+		return fprintf(stderr,"%s: error: too many tracks!\n",s),1;
+	if (!(dsk_image=realloc(dsk_image,disc_imagesize[0]+m*256))) // compacting tracks can only make the image smaller, save the rounding
+		return fprintf(stderr,"%s: error: out of memory!\n",s),1;
+	MEMZERO(disc_scratch);
+	strcpy(disc_scratch,disc_header_text);
+	disc_scratch[0x30]=disc_index_table[0][0x30];
+	disc_scratch[0x31]=n;
+	for (int c=0;c<disc_index_table[0][0x30];++c)
+	{
+		disc_track_load(0,c); // sector sizes of "MV - CPC" discs are filled in here
+		for (int h=0;h<n;++h)
+		{
+			int j=c*n+h,o=disc_track_index[0][j],l=dsk_track_size(j),i,k; BYTE *t=disc_track_table[h*4];
+			if (l>disc_imagesize[0]-o)
+				{ q=fprintf(stderr,"%s: error: track %i:%i is truncated!\n",s,c,h); continue; }
+			if (l<=256||!t[0x15]) // the emulators ignore tracks without sectors
+			{
+				if (dsk_verbose)
+					printf("%s: track %i:%i is unformatted\n",s,c,h);
+				continue;
+			}
+			if (memcmp(t,disc_tracks_text,10))
+				{ q=fprintf(stderr,"%s: error: track %i:%i lacks its header!\n",s,c,h); continue; }
+			if (t[0x10]!=c||t[0x11]!=h)
+				fprintf(stderr,"%s: warning: track %i:%i is labelled %i:%i\n",s,c,h,t[0x10],t[0x11]);
+			if (t[0x15]>DISC_SECTOR_MAX)
+				{ q=fprintf(stderr,"%s: error: track %i:%i has %i sectors!\n",s,c,h,t[0x15]); continue; }
+			for (k=t[0x15]>29?512:256,i=0;i<t[0x15];++i) // tracks with >29 sectors use 512 bytes rather than just the first 256 bytes
+				k+=disc_sector_size(h*4,i);
+			if (k>l)
+				{ q=fprintf(stderr,"%s: error: track %i:%i needs %i bytes but holds %i!\n",s,c,h,k,l); continue; }
+			if ((i=(k+255)>>8)>255)
+				{ q=fprintf(stderr,"%s: error: track %i:%i is too long!\n",s,c,h); continue; }
+			if (dsk_verbose)
+				printf("%s: track %i:%i has %i sectors, %i/%i bytes\n",s,c,h,t[0x15],k,l);
+			disc_scratch[j+0x34]=i;
+			memset(&dsk_image[z],0,i<<8);
+			memcpy(&dsk_image[z],t,t[0x15]>29?512:256); // the header, with the explicit sector sizes
+			memcpy(&dsk_image[z+(t[0x15]>29?512:256)],&disc_image[0][o+(t[0x15]>29?512:256)],k-(t[0x15]>29?512:256)); // the sector data
+			z+=i<<8;
+		}
+	}
+	memcpy(dsk_image,disc_scratch,256);
+	if (dsk_verbose&&m&&(m=disc_track_index[0][m-1]+dsk_track_size(m-1))<disc_imagesize[0])
+		printf("%s: %i bytes after the last track\n",s,disc_imagesize[0]-m);
+	return dsk_length=z,q;
+}
+
+// ------------------------------------------------------------------ //
+
+int main(int argc,char *argv[])
+{
+	char *t=NULL; int i=0,j=0,check=0,bad=0;
+	while (++i<argc)
+	{
+		if (!strcmp("-c",argv[i]))
+			check=1,argv[i]=NULL;
+		else if (!strcmp("-v",argv[i]))
+			dsk_verbose=1,argv[i]=NULL;
+		else if (!strcmp("-o",argv[i])&&!t&&i+1<argc)
+			argv[i]=NULL,t=argv[++i],argv[i]=NULL;
+		else if (*argv[i]=='-')
+			i=argc; // help!
+		else
+			++j;
+	}
+	if (!j||(t&&j>1)||i>argc)
+	{
+		printf(MY_CAPTION " " MY_VERSION " " MY_LICENSE "\n"
+			"\n"
+			"usage: dsktool [-v] [-c] source.dsk [source.dsk...]\n"
+			"       dsktool [-v] source.dsk -o target.dsk\n"
+			"\n"
+			"  -c\tcheck the discs without rewriting them\n"
+			"  -o\twrite the compact disc into a new file\n"
+			"  -v\tshow every track\n"
+			"\n"
+			"Discs are rewritten in place unless -c or -o are given.\n"
+			"\n"
+			"This program comes with ABSOLUTELY NO WARRANTY; for more details" "\n" \
+			"please read the GNU General Public License. This is free software" "\n" \
+			"and you are welcome to redistribute it under certain conditions." // GPL_3_INFO
+			"\n");
+		return 1;
+	}
+	for (i=1;i<argc;++i)
+		if (argv[i])
+		{
+			char *s=argv[i];
+			if (dsk_repack(s))
+				++bad,fprintf(stderr,"%s: left untouched.\n",s);
+			else if (dsk_length==disc_imagesize[0]&&!memcmp(dsk_image,disc_image[0],dsk_length)&&!t)
+				printf("%s: ok, already compact.\n",s);
+			else if (check)
+				printf("%s: ok, %i bytes, %i once compacted.\n",s,disc_imagesize[0],dsk_length);
+			else
+			{
+				int l=disc_imagesize[0];
+				free(disc_image[0]); // the disc support saves the new image in the old one's place
+				disc_image[0]=dsk_image,dsk_image=NULL;
+				disc_imagesize[0]=dsk_length,disc_imagedirty[0]=1;
+				strcpy(disc_imagepath[0],t?t:s);
+				if (disc_image_flush(0))
+					++bad,fprintf(stderr,"%s: error: cannot write %s!\n",s,t?t:s);
+				else
+					printf("%s: ok, %i bytes, %i once compacted.\n",s,l,dsk_length);
+			}
+			disc_close(0);
+		}
+	free(dsk_image);
+	return bad!=0;
+}
@@ -39,6 +39,7 @@ Contact information: <mailto:cngsoft@gmail.com> */
 #include <stdio.h> // printf()...
 #include <stdlib.h> // strtol()...
 #include <string.h> // strcpy()...
+#include <time.h> // clock()...
 
 // ZX Spectrum metrics and constants defined as general types ------- //
 
@@ -275,8 +276,12 @@ const int mmu_ram_mode[4][4]= // relative offsets of every bank for each PLUS3 R
 	{ 0x10000-0x0000,0x14000-0x4000,0x18000-0x8000,0x0C000-0xC000 }, // V3=5: 4 5 6 3
 	{ 0x10000-0x0000,0x1C000-0x4000,0x18000-0x8000,0x0C000-0xC000 }, // V3=7: 4 7 6 3
 };
+BYTE z80_tape_stamp=0; // the tape trap cache only stays valid while the memory map doesn't change
+WORD z80_tape_index[1<<16]; // full Z80 16-bit cache: pattern in the low byte (255 when unused), `z80_tape_stamp` in the high byte
 void mmu_update(void) // update the MMU tables with all the new offsets
 {
+	if (!++z80_tape_stamp) // the code at any address may be a different one now
+		MEMFULL(z80_tape_index); // the stamp wrapped: old entries would look valid again
 	// the general idea is as follows: contention applies to the banks:
 	// V1 (48k): area 4000-7FFF (equivalent to 128k bank 5)
 	// V2 (128k,Plus2): banks 1,3,5,7
@@ -350,6 +355,9 @@ void ula_reset(void) // reset the ULA
 #if AUDIO_CHANNELS > 1
 int psg_stereo[3][2]; const int psg_stereos[][3]={{0,0,0},{+256,-256,0},{+128,-128,0},{+64,-64,0}}; // A left, C middle, B right
 #endif
+#define PSG_PLAYCITY 1750 // the TurboSound chip runs at the same clock as the AY
+#define PSG_PLAYCITY_CHIPS 1
+BYTE playcity_disabled=1,playcity_active=0; // TurboSound: writing 0xFE or 0xFF to port 0xFFFD selects the second or the first chip
 
 #include "cpcec-ay.h"
 
@@ -621,8 +629,17 @@ void z80_send(WORD p,BYTE b) // the Z80 sends a byte to a hardware port
 			if (type_id||!psg_disabled) // optional on 48K
 			{
 				if (p&0x4000) // 0xFFFD: SELECT PSG REGISTER
-					psg_table_select(b);
-				else // 0xBFFD: WRITE PSG REGISTER
+				{
+					if (!playcity_disabled&&b>=0xFE) // TURBOSOUND: SELECT PSG CHIP
+						playcity_active=b==0xFE;
+					else if (playcity_active)
+						playcity_select(0,b);
+					else
+						psg_table_select(b);
+				}
+				else if (playcity_active) // 0xBFFD: WRITE PSG REGISTER
+					playcity_send(0,b);
+				else
 					psg_table_send(b);
 			}
 	}
@@ -633,7 +650,6 @@ void z80_send(WORD p,BYTE b) // the Z80 sends a byte to a hardware port
 // * tape_fastload controls the logical method (detecting tape loaders and feeding them data straight from the tape)
 
 int tape_skipload=1,tape_fastload=1,tape_skipping=0;
-BYTE z80_tape_index[1<<16]; // full Z80 16-bit cache
 
 BYTE z80_tape_fastload[][32] = { // codes that read pulses : <offset, length, data> x N) -------------------------------------------------------------- MAXIMUM WIDTH //
 	/*  0 */ {  -6,   3,0X04,0XC8,0X3E,  +1,   9,0XDB,0XFE,0X1F,0XD0,0XA9,0XE6,0X20,0X28,0XF3 }, // ZX SPECTRUM FIRMWARE
@@ -674,22 +690,23 @@ BYTE z80_tape_fastdump[][32] = { // codes that fill blocks
 	/*  6 */ { -28,   7,0XDD,0X75,0X00,0XDD,0X23,0X1B,0X06,  +1,   4,0X2E,0X01,0x00,0x3E, +29,   7,0X7C,0XAD,0X67,0X7A,0XB3,0X20,0XD0 }, // SPEEDLOCK V1
 };
 
+BYTE z80_tape_fastload_hash[257+length(z80_tape_fastload)],z80_tape_fastfeed_hash[257+length(z80_tape_fastfeed)],z80_tape_fastdump_hash[257+length(z80_tape_fastdump)];
 WORD z80_tape_spystack(WORD d) { d+=z80_sp.w; return PEEK(d)+256*PEEK(d+1); }
 int z80_tape_testfeed(WORD p)
 {
-	int i; if ((i=z80_tape_index[p])>length(z80_tape_fastfeed))
+	int i=z80_tape_index[p];
+	if (i>>8!=z80_tape_stamp||(i&=255)>length(z80_tape_fastfeed)||(i<length(z80_tape_fastfeed)&&!fasttape_test(z80_tape_fastfeed[i],p)))
 	{
-		for (i=0;i<length(z80_tape_fastfeed)&&!fasttape_test(z80_tape_fastfeed[i],p);++i) ;
-		z80_tape_index[p]=i; logprintf("FASTFEED: %04X=%02i\n",p,(i<length(z80_tape_fastfeed))?i:-1);
+		z80_tape_index[p]=z80_tape_stamp*256+(i=fasttape_find(z80_tape_fastfeed,length(z80_tape_fastfeed),z80_tape_fastfeed_hash,p)); logprintf("FASTFEED: %04X=%02i\n",p,(i<length(z80_tape_fastfeed))?i:-1);
 	}
 	return i;
 }
 int z80_tape_testdump(WORD p)
 {
-	int i; if ((i=z80_tape_index[p-1])>length(z80_tape_fastdump)) // the offset avoid conflicts with TABLE2
+	int i=z80_tape_index[p-1];
+	if (i>>8!=z80_tape_stamp||(i&=255)>length(z80_tape_fastdump)||(i<length(z80_tape_fastdump)&&!fasttape_test(z80_tape_fastdump[i],p))) // the offset avoid conflicts with TABLE2
 	{
-		for (i=0;i<length(z80_tape_fastdump)&&!fasttape_test(z80_tape_fastdump[i],p);++i) ;
-		z80_tape_index[p-1]=i; logprintf("FASTDUMP: %04X=%02i\n",p,(i<length(z80_tape_fastdump))?i:-1);
+		z80_tape_index[p-1]=z80_tape_stamp*256+(i=fasttape_find(z80_tape_fastdump,length(z80_tape_fastdump),z80_tape_fastdump_hash,p)); logprintf("FASTDUMP: %04X=%02i\n",p,(i<length(z80_tape_fastdump))?i:-1);
 	}
 	return i;
 }
@@ -697,12 +714,12 @@ int z80_tape_testdump(WORD p)
 void z80_tape_trap(void)
 {
 	int i,j,k;
-	if ((i=z80_tape_index[z80_pc.w])>length(z80_tape_fastload))
+	if ((i=z80_tape_index[z80_pc.w])>>8!=z80_tape_stamp||(i&=255)>length(z80_tape_fastload)||(i<length(z80_tape_fastload)&&!fasttape_test(z80_tape_fastload[i],z80_pc.w))) // outdated, unknown or overwritten?
 	{
-		for (i=0;i<length(z80_tape_fastload)&&!fasttape_test(z80_tape_fastload[i],z80_pc.w);++i) ;
-		z80_tape_index[z80_pc.w]=i; logprintf("FASTLOAD: %04X=%02i\n",z80_pc.w,(i<length(z80_tape_fastload))?i:-1);
+		z80_tape_index[z80_pc.w]=z80_tape_stamp*256+(i=fasttape_find(z80_tape_fastload,length(z80_tape_fastload),z80_tape_fastload_hash,z80_pc.w)); logprintf("FASTLOAD: %04X=%02i\n",z80_pc.w,(i<length(z80_tape_fastload))?i:-1);
 	}
-	if (i>=length(z80_tape_fastload)) return; // only known methods can reach here!
+	if (i>=length(z80_tape_fastload)) { tape_stats_miss(z80_pc.w); return; } // only known methods can reach here!
+	++tape_stats_traps;
 	if (tape_enabled>=0&&tape_enabled<2) // automatic tape playback/stop?
 		tape_enabled=2; // amount of frames the tape should keep moving
 	if (!tape_skipping) tape_skipping=-1;
@@ -726,7 +743,7 @@ void z80_tape_trap(void)
 			if (z80_hl.b.l==0x01&&FASTTAPE_CAN_FEED()&&((j=z80_tape_testfeed(z80_tape_spystack(0)))==0||j==3))
 			{
 				if (z80_af2.b.l&0x40) if ((k=z80_tape_testdump(z80_tape_spystack(0)))==0||k==5)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1&&((WORD)(z80_ix.w-z80_sp.w)>2))
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1&&((WORD)(z80_ix.w-z80_sp.w)>2))
 						z80_hl.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de.w;
 				k=fasttape_feed(z80_bc.b.l>>5,59),tape_skipping=z80_hl.b.l=128+(k>>1),z80_bc.b.h=-(k&1);
 			}
@@ -739,7 +756,7 @@ void z80_tape_trap(void)
 			if (z80_hl.b.l==0x01&&FASTTAPE_CAN_FEED()&&((j=z80_tape_testfeed(z80_tape_spystack(0)))==0||j==1))
 			{
 				if (z80_af2.b.l&0x40) if ((k=z80_tape_testdump(z80_tape_spystack(0)))==0||k==1||k==2)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						z80_hl.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de.w;
 				k=fasttape_feed(z80_bc.b.l>>5,58),tape_skipping=z80_hl.b.l=128+(k>>1),z80_bc.b.h=-(k&1);
 			}
@@ -767,7 +784,7 @@ void z80_tape_trap(void)
 			if (z80_hl.b.l==0x01&&FASTTAPE_CAN_FEED()&&((j=z80_tape_testfeed(z80_tape_spystack(0)))==0||j==3||j==5||j==6))
 			{
 				if ((((k=z80_tape_testdump(z80_tape_spystack(0)))==1||k==5)&&z80_af2.b.l&0x40)||k==6) // SPEEDLOCK V1 ignores AF2
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						z80_hl.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de.w;
 				k=fasttape_feed(z80_bc.b.l>>5,54),tape_skipping=z80_hl.b.l=128+(k>>1),z80_bc.b.h=-(k&1);
 			}
@@ -780,7 +797,7 @@ void z80_tape_trap(void)
 			if (z80_hl.b.l==0x01&&FASTTAPE_CAN_FEED()&&((j=z80_tape_testfeed(z80_tape_spystack(0)))==0||j==2||j==7))
 			{
 				if ((k=z80_tape_testdump(z80_tape_spystack(0)))==0||k==3)
-					while (FASTTAPE_CAN_DUMP()&&z80_de.b.l>1)
+					while (FASTTAPE_CAN_DUMP()&&z80_de.w>1)
 						z80_hl.b.h^=POKE(z80_ix.w)=fasttape_dump(),++z80_ix.w,--z80_de.w;
 				k=fasttape_feed(z80_bc.b.l>>5,59),tape_skipping=z80_hl.b.l=128+(k>>1),z80_bc.b.h=-(k&1);
 			}
@@ -835,7 +852,7 @@ BYTE z80_recv(WORD p) // the Z80 receives a byte from a hardware port
 		}
 		else if ((p&0xC000)==0xC000) // 0xFFFD: READ PSG REGISTER
 			if (type_id||!psg_disabled) // !48K?
-				b=psg_table_recv();
+				b=playcity_active?playcity_recv(0):psg_table_recv();
 	}
 	else if ((p&255)==255&&type_id<3) // NON-PLUS3: FLOATING BUS
 		b=ula_temp; // not completely equivalent to z80_bus()
@@ -874,6 +891,7 @@ void z80_debug_hard(int q,int x,int y)
 	t+=sprintf(t,"FDC:  %02X - %04X:%04X" "    %c ",disc_parmtr[0],(WORD)disc_offset,(WORD)disc_length,48+disc_phase);
 	for (i=0;i<7;++i)
 		t+=sprintf(t,"%02X",disc_result[i]);
+	t+=tape_stats_debug(t);
 	char *r=t;
 	for (t=s;t<r;++y)
 	{
@@ -1013,11 +1031,14 @@ void all_reset(void) // reset everything!
 	tape_enabled=0;
 	tape_reset();
 	disc_reset();
-	psg_reset();
+	psg_reset(); playcity_reset(),playcity_active=0;
 	z80_reset();
 	z80_debug_reset();
 	snap_done=0; // avoid accidents!
 	MEMFULL(z80_tape_index);
+	fasttape_hash(z80_tape_fastload,length(z80_tape_fastload),z80_tape_fastload_hash);
+	fasttape_hash(z80_tape_fastfeed,length(z80_tape_fastfeed),z80_tape_fastfeed_hash);
+	fasttape_hash(z80_tape_fastdump,length(z80_tape_fastdump),z80_tape_fastdump_hash);
 }
 
 // firmware ROM file handling operations ---------------------------- //
@@ -1327,6 +1348,46 @@ int snap_load(char *s) // load a snapshot. `s` path, NULL to reload; 0 OK, !0 ER
 
 // "autorun" file and logic operations ------------------------------ //
 
+unsigned int disc_hash(int drive) // returns the CRC32 of the tracks of disc `drive`, without the disc header and the track headers
+{
+	unsigned int k=~0; int i,j,n=disc_index_table[drive][0x30]*disc_index_table[drive][0x31];
+	for (i=0;i<n;++i)
+		if ((j=(i+1<n?disc_track_index[drive][i+1]:disc_imagesize[drive])-disc_track_index[drive][i]-256)>0&&disc_track_index[drive][i]+256+j<=disc_imagesize[drive])
+			k=puff_dohash(k,&disc_image[drive][disc_track_index[drive][i]+256],j);
+	return ~k;
+}
+int any_load_user[2],any_load_used[2],any_load_mask=0; // the user's settings that a known title replaced, the values it used instead, and which ones
+#define ANY_LOAD_SET(n,v,x) ((any_load_mask&(1<<n))||(any_load_user[n]=v),any_load_mask|=1<<n,any_load_used[n]=v=x)
+void any_load_undo(void) // give the user's settings back, unless the user changed them since
+{
+	if (any_load_mask&1&&type_id==any_load_used[0]) type_id=any_load_user[0];
+	if (any_load_mask&2&&tape_fastload==any_load_used[1]) tape_fastload=any_load_user[1];
+	any_load_mask=0;
+}
+void any_load_setup(unsigned int k) // apply the settings of the disc or tape whose CRC32 is `k`, if the database knows it; they use the same names as the configuration file, plus "fast" (tape analysis)
+{
+	char s[STRMAX],*t,*u; int i; logprintf("SETTINGS: %08X",k);
+	any_load_undo(); // the settings of the previous title don't apply anymore
+	if (!session_dbfind(s,k))
+		for (t=strtok(s," \t");t&&(u=strtok(NULL," \t"));t=strtok(NULL," \t"))
+		{
+			logprintf(" %s=%s",t,u);
+			if (!strcasecmp(t,"type")) { if ((i=*u&15)<length(bios_system)) ANY_LOAD_SET(0,type_id,i); }
+			else if (!strcasecmp(t,"fast")) ANY_LOAD_SET(1,tape_fastload,*u&1);
+		}
+	logprintf("\n");
+}
+
+void any_disc_close(int drive) // close the disc before another one replaces it, warning if its changes were lost
+{
+	if (disc_close(drive))
+		session_message("Cannot save disc!",txt_error);
+}
+void any_tape_close(void) // close the tape before another one replaces it, warning if the recording failed
+{
+	if (tape_close())
+		session_message("Cannot record tape!",txt_error);
+}
 int any_load(char *s,int q) // load a file regardless of format. `s` path, `q` autorun; 0 OK, !0 ERROR
 {
 	autorun_t=autorun_mode=0; // cancel any autoloading yet
@@ -1334,17 +1395,18 @@ int any_load(char *s,int q) // load a file regardless of format. `s` path, `q` a
 	{
 		if (bios_load(s))
 		{
-			if (tape_open(s))
+			if (any_tape_close(),tape_open(s))
 			{
-				if (disc_open(s,0,0))
+				if (any_disc_close(0),disc_open(s,0,0))
 					return 1; // everything failed!
 				if (q)
 					type_id=3,disc_disabled=0,tape_close(); // open disc? force PLUS3, enable disc, close tapes!
 			}
 			else if (q)
-				type_id=(type_id>2?2:type_id),disc_disabled|=2,disc_close(0),disc_close(1); // open tape? force PLUS2 if PLUS3, close disc!
+				type_id=(type_id>2?2:type_id),disc_disabled|=2,any_disc_close(0),any_disc_close(1); // open tape? force PLUS2 if PLUS3, close disc!
 			if (q) // autorun for tape and disc
 			{
+				any_load_setup(disc_disabled?tape_hash():disc_hash(0)); // known settings, if any
 				all_reset(),bios_reload();
 				autorun_mode=type_id?8:1; // only 48k needs typing
 				autorun_t=((type_id==3&&!disc_disabled)?-144:(type_id?-72:-96)); // PLUS3 slowest, 128+PLUS2 fast, 48k slow
@@ -1385,10 +1447,12 @@ char session_menudata[]=
 	"0x8701 Create disc in A:..\n"
 	"0x0700 Remove disc from A:\tCtrl+F7\n"
 	"0x0701 Flip disc sides in A:\n"
+	"0x0702 Save disc changes in A:\n"
 	"0xC700 Insert disc into B:..\tShift+F7\n"
 	"0xC701 Create disc in B:..\n"
 	"0x4700 Remove disc from B:\tCtrl+Shift+F7\n"
 	"0x4701 Flip disc sides in B:\n"
+	"0x4702 Save disc changes in B:\n"
 	"=\n"
 	"0x8800 Insert tape..\tF8\n"
 	"0xC800 Record tape..\tShift+F8\n"
@@ -1427,6 +1491,7 @@ char session_menudata[]=
 	"0x8512 ULA video noise\n"
 	"0x8513 Issue-2 ULA line\n"
 	"0x8514 AY-Melodik chip\n"
+	"0x8515 TurboSound chip\n"
 	"=\n"
 	"0x851F Strict SNA files\n"
 	"0x8510 Disc controller\n"
@@ -1483,6 +1548,7 @@ char session_menudata[]=
 	"=\n"
 	"0x0C00 Record WAV file\tCtrl+F12\n"
 	"0x4C00 Record YM file\tCtrl+Shift+F12\n"
+	"0x0C01 Record AY stems\n"
 	"Help\n"
 	"0x8100 Help..\tF1\n"
 	"0x0100 About..\tCtrl+F1\n"
@@ -1500,6 +1566,7 @@ void session_menuinfo(void)
 	session_menucheck(0xCC00,(size_t)session_filmfile);
 	session_menucheck(0x0C00,(size_t)session_wavefile);
 	session_menucheck(0x4C00,(size_t)psg_logfile);
+	session_menucheck(0x0C01,(size_t)psg_stemfile);
 	session_menucheck(0x8700,(size_t)disc[0]);
 	session_menucheck(0xC700,(size_t)disc[1]);
 	session_menucheck(0x0701,disc_flip[0]);
@@ -1521,6 +1588,7 @@ void session_menuinfo(void)
 	session_menucheck(0x8512,!(ula_snow_disabled));
 	session_menucheck(0x8513,ula_v1_issue!=ULA_V1_ISSUE3);
 	session_menucheck(0x8514,!psg_disabled);
+	session_menucheck(0x8515,!playcity_disabled);
 	session_menucheck(0x851F,!(snap_extended));
 	session_menucheck(0x8901,onscreen_flag);
 	session_menucheck(0x8A00,session_fullscreen);
@@ -1537,6 +1605,7 @@ void session_menuinfo(void)
 	session_menuradio(0xC401+audio_mixmode,0xC401,0xC404);
 	for (int i=0;i<3;++i)
 		psg_stereo[i][0]=256+psg_stereos[audio_mixmode][i],psg_stereo[i][1]=256-psg_stereos[audio_mixmode][i];
+	MEMLOAD(playcity_stereo[0],psg_stereo); // the TurboSound chip follows the AY layout
 	#endif
 	video_resetscanline(); // video scanline cfg
 	z80_multi=1+z80_turbo; // setup overclocking
@@ -1706,6 +1775,10 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 			if ((psg_disabled=!psg_disabled)&&!type_id) // mute on 48k!
 				psg_table_sendto(8,0),psg_table_sendto(9,0),psg_table_sendto(10,0);
 			break;
+		case 0x8515: // TURBOSOUND
+			if (playcity_disabled=!playcity_disabled)
+				playcity_reset(),playcity_active=0;
+			break;
 		case 0x851F:
 			snap_extended=!snap_extended;
 			break;
@@ -1737,7 +1810,7 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 			if (type_id==3&&!disc_disabled)
 				if (s=puff_session_newfile(disc_path,"*.dsk",session_shift?"Create disc in B:":"Create disc in A:"))
 				{
-					if (disc_create(s))
+					if (any_disc_close(session_shift),disc_create(s))
 						session_message("Cannot create disc!",txt_error);
 					else
 						disc_open(s,session_shift,1);
@@ -1746,24 +1819,28 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 		case 0x8700: // F7: INSERT DISC..
 			if (type_id==3&&!disc_disabled)
 				if (s=puff_session_getfilereadonly(disc_path,"*.dsk",session_shift?"Insert disc into B:":"Insert disc into A:",disc_filemode&1))
-					if (disc_open(s,session_shift,!session_filedialog_get_readonly()))
+					if (any_disc_close(session_shift),disc_open(s,session_shift,!session_filedialog_get_readonly()&&!strrstr(s,PUFF_STR))) // discs inside ZIP archives cannot be saved
 						session_message("Cannot open disc!",txt_error);
 			break;
 		case 0x0700: // ^F7: EJECT DISC
-			disc_close(session_shift);
+			any_disc_close(session_shift);
 			break;
 		case 0x0701:
 			disc_flip[session_shift]^=1;
 			break;
+		case 0x0702: // SAVE DISC CHANGES
+			if (disc_image_flush(session_shift))
+				session_message("Cannot save disc!",txt_error);
+			break;
 		case 0x8800: // F8: INSERT OR RECORD TAPE..
 			if (session_shift)
 			{
-				if (s=puff_session_newfile(tape_path,"*.csw","Record tape"))
-					if (tape_create(s))
+				if (s=puff_session_newfile(tape_path,"*.csw;*.tzx","Record tape"))
+					if (any_tape_close(),tape_create(s))
 						session_message("Cannot create tape!",txt_error);
 			}
 			else if (s=puff_session_getfile(tape_path,"*.tap;*.tzx;*.csw;*.wav","Insert tape"))
-				if (tape_open(s))
+				if (any_tape_close(),tape_open(s))
 					session_message("Cannot open tape!",txt_error);
 			break;
 		case 0x8801: // BROWSE TAPE
@@ -1774,7 +1851,7 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 				{
 					sprintf(session_parmtr,"Browse tape %s",tape_path);
 					if (session_list(i,session_scratch,session_parmtr)>=0)
-						tape_select(strtol(session_parmtr,NULL,10));
+						tape_select_block(tape_block_find(strtol(session_parmtr,NULL,10))); // each item begins with the offset of its block
 				}
 			}
 			break;
@@ -1787,7 +1864,7 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 					tape_enabled=-1; // play all the frames, forever
 			}
 			else
-				tape_close();
+				any_tape_close();
 			break;
 		case 0x8900: // F9: DEBUG
 			if (!session_shift)
@@ -1878,6 +1955,11 @@ int session_user(int k) // handle the user's commands; 0 OK, !0 ERROR
 			else if (session_closewave()) // toggles recording
 				session_createwave();
 			break;
+		case 0x0C01: // RECORD AY STEMS
+			if (psg_closestem()) // toggles recording
+				if (psg_nextstem=session_savenext("%s%08i.stems.wav",psg_nextstem))
+					psg_createstem(session_parmtr);
+			break;
 		case 0x8F00: // ^PAUSE
 		case 0x0F00: // PAUSE
 			if (!(session_signal&SESSION_SIGNAL_DEBUG))
@@ -1921,6 +2003,7 @@ void session_configreadmore(char *s)
 	else if (!strcasecmp(session_parmtr,"type")) { if ((i=*s&15)<length(bios_system)) type_id=i; }
 	else if (!strcasecmp(session_parmtr,"xsna")) snap_extended=*s&1;
 	else if (!strcasecmp(session_parmtr,"fdcw")) disc_filemode=*s&3;
+	else if (!strcasecmp(session_parmtr,"tsnd")) playcity_disabled=!(*s&1);
 	else if (!strcasecmp(session_parmtr,"joy1")) { if ((i=*s&15)<length(joy1_types)) joy1_type=i; }
 	else if (!strcasecmp(session_parmtr,"file")) strcpy(autorun_path,s);
 	else if (!strcasecmp(session_parmtr,"snap")) strcpy(snap_path,s);
@@ -1933,10 +2016,10 @@ void session_configreadmore(char *s)
 }
 void session_configwritemore(FILE *f)
 {
-	fprintf(f,"type %i\njoy1 %i\nxsna %i\nfdcw %i\n"
+	fprintf(f,"type %i\njoy1 %i\nxsna %i\nfdcw %i\ntsnd %i\n"
 		"file %s\nsnap %s\ntape %s\ndisc %s\ncard %s\n"
 		"palette %i\nrewind %i\ndebug %i\n"
-		,type_id,joy1_type,snap_extended,disc_filemode,
+		,type_id,joy1_type,snap_extended,disc_filemode,!playcity_disabled,
 		autorun_path,snap_path,tape_path,disc_path,bios_path,
 		video_type,tape_rewind,z80_debug_configwrite());
 }
@@ -1953,7 +2036,7 @@ void printferror(char *s) { sprintf(session_tmpstr,"Error: %s\n",s); session_mes
 
 int main(int argc,char *argv[])
 {
-	int i,j; FILE *f;
+	int i,j,k=-1; FILE *f,*stats_file=NULL; // `k` is the starting position of the tape, in seconds; `stats_file` gets the tape telemetry
 	session_detectpath(argv[0]);
 	if (f=fopen(session_configfile(),"r"))
 	{
@@ -1973,6 +2056,14 @@ int main(int argc,char *argv[])
 			{
 				switch (argv[i][j++])
 				{
+					case 'a':
+						for (session_headframes=0;argv[i][j]>='0'&&argv[i][j]<='9';++j)
+							session_headframes=session_headframes*10+argv[i][j]-'0';
+						if ((session_headframes*=VIDEO_PLAYBACK)<=0)
+							i=argc; // help!
+						else
+							session_headless=1;
+						break;
 					case 'c':
 						video_scanline=(BYTE)(argv[i][j++]-'0');
 						if (video_scanline<0||video_scanline>7)
@@ -2024,6 +2115,10 @@ int main(int argc,char *argv[])
 					case 'S':
 						session_audio=0;
 						break;
+					case 't':
+						for (k=0;argv[i][j]>='0'&&argv[i][j]<='9';++j)
+							k=k*10+argv[i][j]-'0';
+						break;
 					case 'T':
 						audio_mixmode=0;
 						break;
@@ -2033,6 +2128,10 @@ int main(int argc,char *argv[])
 					case 'X':
 						disc_disabled=1;
 						break;
+					case 'y':
+						if (!stats_file&&!(stats_file=fopen(strcat(strcpy(session_parmtr,session_path),my_caption ".json"),"w")))
+							i=argc; // help!
+						break;
 					case 'Y':
 						tape_fastload=0;
 						break;
@@ -2062,6 +2161,7 @@ int main(int argc,char *argv[])
 		return
 			printfusage("usage: " MY_CAPTION
 			" [option..] [file..]\n"
+			"\t-aN\trender N seconds of audio without window\n"
 			"\t-cN\tscanline type (0..7)\n"
 			"\t-CN\tcolour palette (0..4)\n"
 			"\t-d\tdebug\n"
@@ -2082,25 +2182,38 @@ int main(int argc,char *argv[])
 			"\t-rN\tset frameskip (0..9)\n"
 			"\t-R\tdisable realtime\n"
 			"\t-S\tdisable sound\n"
+			"\t-tN\tstart the tape at second N\n"
 			"\t-T\tdisable stereo\n"
 			"\t-W\tfullscreen mode\n"
 			"\t-X\tdisable +3 disc drive\n"
+			"\t-y\tsave tape statistics into " my_caption ".json\n"
 			"\t-Y\tdisable tape analysis\n"
 			"\t-Z\tdisable tape speed-up\n"
 			"\t-!\tforce software render\n"
 			),1;
+	if (k>=0&&tape_select_time(k*1000))
+		return printferror("Cannot seek tape!"),1;
 	if (bios_reload())
 		return printferror("Cannot load firmware!"),1;
-	char *s; if (s=session_create(session_menudata))
+	char *s; if (session_headless) // just the emulation and the wavefile, as fast as possible
+	{
+		if (!(video_frame=malloc(sizeof(VIDEO_UNIT)*VIDEO_LENGTH_X*VIDEO_LENGTH_Y)))
+			return printferror("Cannot allocate memory!"),1;
+		audio_frame=audio_buffer; session_fast=1; onscreen_flag=0; video_framelimit=MAIN_FRAMESKIP_MASK;
+		if (session_createwave())
+			return printferror("Cannot create wavefile!"),1;
+		session_menuinfo(); // no window, no menu: but the audio mixer must be set all the same
+	}
+	else if (s=session_create(session_menudata))
 		return sprintf(session_scratch,"Cannot create session: %s!",s),printferror(session_scratch),1;
 	session_kbdreset();
 	session_kbdsetup(kbd_map_xlt,length(kbd_map_xlt)/2);
 	video_target=&video_frame[video_pos_y*VIDEO_LENGTH_X+video_pos_y]; audio_target=audio_frame;
 	audio_disabled=!session_audio;
 	video_clut_update(); onscreen_inks(VIDEO1(0xAA0000),VIDEO1(0x55FF55));
-	if (session_fullscreen) session_togglefullscreen();
+	if (session_fullscreen&&!session_headless) session_togglefullscreen();
 	// it begins, "alea jacta est!"
-	while (!session_listen())
+	while (session_headless?session_headframes>0:!session_listen())
 	{
 		while (!session_signal)
 			z80_main(
@@ -2112,6 +2225,9 @@ int main(int argc,char *argv[])
 			);
 		if (session_signal&SESSION_SIGNAL_FRAME) // end of frame?
 		{
+			tape_stats_frame(tape_enabled); // tape telemetry
+			if (video_framelimit>MAIN_FRAMESKIP_MASK&&video_framecount>=MAIN_FRAMESKIP_MASK) // loading turbo?
+				video_framecount=0; // show the last frame we drew, the status and the progress bar
 			if (!video_framecount&&onscreen_flag)
 			{
 				if (type_id<3||disc_disabled)
@@ -2136,6 +2252,8 @@ int main(int argc,char *argv[])
 				}
 				else
 					onscreen_text(+7, -3, tape_type < 0 ? "REC" : "---", q);
+				if (video_framelimit>MAIN_FRAMESKIP_MASK&&tape_filesize) // loading turbo? show the progress bar
+					i=(long long)tape_filetell*16/(tape_filesize+1),onscreen_bool(+11,-3,i,1,1),onscreen_bool(+11+i,-3,16-i,1,0);
 				if (session_stick|session_key2joy)
 				{
 					onscreen_bool(-5,-6,3,1,kbd_bit_tst(kbd_joy[0]));
@@ -2160,9 +2278,13 @@ int main(int argc,char *argv[])
 			if (autorun_mode)
 				autorun_next();
 			if (!audio_disabled)
+			{
 				audio_main(TICKS_PER_FRAME); // fill sound buffer to the brim!
+				if (!playcity_disabled)
+					playcity_main(audio_frame,AUDIO_LENGTH_Z);
+			}
 			audio_queue=0; // wipe audio queue and force a reset
-			psg_writelog();
+			psg_writelog(); psg_writestem();
 			ula_snow_a=0; // zero or random step?
 			if (!ula_snow_disabled)
 			{
@@ -2187,7 +2309,7 @@ int main(int argc,char *argv[])
 				tape_closed=0,session_dirtymenu=1; // tag tape as closed
 			tape_skipping=audio_pos_z=0;
 			if (tape&&tape_skipload&&tape_enabled)
-				session_fast|=2,video_framelimit|=(MAIN_FRAMESKIP_MASK+1),video_interlaced|=2,audio_disabled|=2; // abuse binary logic to reduce activity
+				session_fast|=2,video_framelimit|=(MAIN_FRAMESKIP_MASK+1),video_interlaced|=2,audio_disabled|=2; // abuse binary logic to reduce activity: the loading turbo doesn't draw any frames
 			else
 				session_fast&=~2,video_framelimit&=~(MAIN_FRAMESKIP_MASK+1),video_interlaced&=~2,audio_disabled&=~2; // ditto, to restore normal activity
 			session_update();
@@ -2195,14 +2317,19 @@ int main(int argc,char *argv[])
 	}
 	// it's over, "acta est fabula"
 	z80_close();
-	tape_close();
-	disc_close(0); disc_close(1);
-	psg_closelog();
+	if (stats_file)
+		tape_stats_json(stats_file),fclose(stats_file);
+	if (tape_close())
+		printferror("Cannot record tape!");
+	if (disc_close(0)|disc_close(1))
+		printferror("Cannot save disc!");
+	psg_closelog(); psg_closestem();
 	session_closefilm();
 	session_closewave();
-	if (f=fopen(session_configfile(),"w"))
+	any_load_undo(); // the configuration keeps the settings of the user, not those of the last title
+	if (!session_headless&&(f=fopen(session_configfile(),"w"))) // headless runs override several settings; don't keep them
 		session_configwritemore(f),session_configwrite(f),fclose(f);
-	return puff_byebye(),session_byebye(),0;
+	return puff_byebye(),session_headless?free(video_frame):session_byebye(),0;
 }
 
 BOOTSTRAP